@@ -3670,6 +3670,255 @@ png_read_filter_row_paeth_multibyte_pixel(png_row_infop row_info, png_bytep row,
    }
 }
 
+/* SSE2/SSSE3 versions of the filters for 3 and 4 byte pixels (8-bit RGB and
+ * RGBA, i.e. nearly every screenshot), chosen at run time by
+ * png_init_filter_functions.  Sub, Avg and Paeth are serial from one pixel to
+ * the next, so these work a pixel at a time with all of its channels in one
+ * register; Up has no such dependency and goes 16 bytes at a time.  The
+ * results are byte-for-byte those of the generic functions above.  Define
+ * PNG_NO_INTEL_FILTERS to leave them out.
+ */
+#if !defined(PNG_NO_INTEL_FILTERS) && (defined(__x86_64__) || \
+    defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#  define PNG_INTEL_FILTERS_SUPPORTED
+#endif
+
+#ifdef PNG_INTEL_FILTERS_SUPPORTED
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#  include <intrin.h>
+#  define PNG_TARGET_SSE2
+#  define PNG_TARGET_SSSE3
+#else
+#  define PNG_TARGET_SSE2 __attribute__((target("sse2")))
+#  define PNG_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+/* 1 for SSE2, 2 for SSSE3 as well */
+static int
+png_intel_filter_level(void)
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 1);
+   if ((info[3] & (1 << 26)) == 0)
+      return 0;
+   return (info[2] & (1 << 9)) != 0 ? 2 : 1;
+#else
+   __builtin_cpu_init();
+   if (!__builtin_cpu_supports("sse2"))
+      return 0;
+   return __builtin_cpu_supports("ssse3") ? 2 : 1;
+#endif
+}
+
+/* Loads and stores go through memcpy as the rows have no alignment; a 3 byte
+ * pixel may be loaded as 4 bytes when at least that many remain in the row.
+ */
+static PNG_TARGET_SSE2 __m128i
+png_load4_sse2(png_const_bytep p)
+{
+   int tmp;
+   memcpy(&tmp, p, 4);
+   return _mm_cvtsi32_si128(tmp);
+}
+
+static PNG_TARGET_SSE2 __m128i
+png_load3_sse2(png_const_bytep p)
+{
+   int tmp = 0;
+   memcpy(&tmp, p, 3);
+   return _mm_cvtsi32_si128(tmp);
+}
+
+static PNG_TARGET_SSE2 void
+png_store_sse2(png_bytep p, __m128i v, unsigned int bpp)
+{
+   int tmp = _mm_cvtsi128_si32(v);
+   if (bpp == 3)
+      memcpy(p, &tmp, 3);
+   else
+      memcpy(p, &tmp, 4);
+}
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_sub_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev_row)
+{
+   png_size_t rb = row_info->rowbytes;
+   unsigned int bpp = (row_info->pixel_depth + 7) >> 3;
+   __m128i d = _mm_setzero_si128();
+
+   PNG_UNUSED(prev_row)
+
+   while (rb >= 4)
+   {
+      d = _mm_add_epi8(d, png_load4_sse2(row));
+      png_store_sse2(row, d, bpp);
+      row += bpp;
+      rb -= bpp;
+   }
+   if (rb > 0)
+   {
+      d = _mm_add_epi8(d, png_load3_sse2(row));
+      png_store_sse2(row, d, 3);
+   }
+}
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_up_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev_row)
+{
+   png_size_t rb = row_info->rowbytes;
+
+   while (rb >= 16)
+   {
+      __m128i d = _mm_loadu_si128((const __m128i *)row);
+      __m128i b = _mm_loadu_si128((const __m128i *)prev_row);
+      _mm_storeu_si128((__m128i *)row, _mm_add_epi8(d, b));
+      row += 16;
+      prev_row += 16;
+      rb -= 16;
+   }
+   while (rb > 0)
+   {
+      *row = (png_byte)(*row + *prev_row++);
+      row++;
+      rb--;
+   }
+}
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_avg_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev_row)
+{
+   png_size_t rb = row_info->rowbytes;
+   unsigned int bpp = (row_info->pixel_depth + 7) >> 3;
+   const __m128i ones = _mm_set1_epi8(1);
+   __m128i a, b, avg, d = _mm_setzero_si128();
+
+   while (rb > 0)
+   {
+      a = d;
+      if (rb >= 4)
+      {
+         b = png_load4_sse2(prev_row);
+         d = png_load4_sse2(row);
+      }
+      else
+      {
+         b = png_load3_sse2(prev_row);
+         d = png_load3_sse2(row);
+      }
+
+      /* _mm_avg_epu8 rounds up where PNG truncates: take the odd bit back */
+      avg = _mm_avg_epu8(a, b);
+      avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(a, b), ones));
+      d = _mm_add_epi8(d, avg);
+      png_store_sse2(row, d, bpp);
+      row += bpp;
+      prev_row += bpp;
+      rb -= bpp;
+   }
+}
+
+static PNG_TARGET_SSE2 __m128i
+png_select_sse2(__m128i mask, __m128i t, __m128i e)
+{
+   return _mm_or_si128(_mm_and_si128(mask, t), _mm_andnot_si128(mask, e));
+}
+
+static PNG_TARGET_SSE2 __m128i
+png_abs16_sse2(__m128i x)
+{
+   __m128i negative = _mm_cmplt_epi16(x, _mm_setzero_si128());
+   return _mm_sub_epi16(_mm_xor_si128(x, negative), negative);
+}
+
+/* The Paeth predictor on 16-bit lanes, ties going to a, then b, as in the
+ * generic code: pa = |b - c|, pb = |a - c|, pc = |(b - c) + (a - c)|.
+ */
+#define PNG_PAETH_SSE(a, b, c, abs16, select) \
+   do { \
+      __m128i pa = _mm_sub_epi16(b, c); \
+      __m128i pb = _mm_sub_epi16(a, c); \
+      __m128i pc = _mm_add_epi16(pa, pb); \
+      __m128i smallest; \
+      pa = abs16(pa); \
+      pb = abs16(pb); \
+      pc = abs16(pc); \
+      smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb)); \
+      predicted = select(_mm_cmpeq_epi16(smallest, pa), a, \
+         select(_mm_cmpeq_epi16(smallest, pb), b, c)); \
+   } while (0)
+
+/* d is kept widened to 16 bits; its lanes never exceed 255 so the byte add
+ * wraps exactly as the generic code's & 0xff does.
+ */
+#define PNG_PAETH_SSE_ROW(abs16) \
+   do { \
+      png_size_t rb = row_info->rowbytes; \
+      unsigned int bpp = (row_info->pixel_depth + 7) >> 3; \
+      const __m128i zero = _mm_setzero_si128(); \
+      __m128i a, b = zero, c, d = zero, predicted; \
+      while (rb > 0) \
+      { \
+         c = b; \
+         a = d; \
+         if (rb >= 4) \
+         { \
+            b = _mm_unpacklo_epi8(png_load4_sse2(prev_row), zero); \
+            d = _mm_unpacklo_epi8(png_load4_sse2(row), zero); \
+         } \
+         else \
+         { \
+            b = _mm_unpacklo_epi8(png_load3_sse2(prev_row), zero); \
+            d = _mm_unpacklo_epi8(png_load3_sse2(row), zero); \
+         } \
+         PNG_PAETH_SSE(a, b, c, abs16, png_select_sse2); \
+         d = _mm_add_epi8(d, predicted); \
+         png_store_sse2(row, _mm_packus_epi16(d, d), bpp); \
+         row += bpp; \
+         prev_row += bpp; \
+         rb -= bpp; \
+      } \
+   } while (0)
+
+static PNG_TARGET_SSE2 void
+png_read_filter_row_paeth_sse2(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev_row)
+{
+   PNG_PAETH_SSE_ROW(png_abs16_sse2);
+}
+
+static PNG_TARGET_SSSE3 void
+png_read_filter_row_paeth_ssse3(png_row_infop row_info, png_bytep row,
+   png_const_bytep prev_row)
+{
+   PNG_PAETH_SSE_ROW(_mm_abs_epi16);
+}
+
+static void
+png_init_filter_functions_intel(png_structp pp, unsigned int bpp)
+{
+   int level;
+
+   if (bpp != 3 && bpp != 4)
+      return;
+
+   level = png_intel_filter_level();
+   if (level < 1)
+      return;
+
+   pp->read_filter[PNG_FILTER_VALUE_SUB-1] = png_read_filter_row_sub_sse2;
+   pp->read_filter[PNG_FILTER_VALUE_UP-1] = png_read_filter_row_up_sse2;
+   pp->read_filter[PNG_FILTER_VALUE_AVG-1] = png_read_filter_row_avg_sse2;
+   pp->read_filter[PNG_FILTER_VALUE_PAETH-1] = level >= 2 ?
+      png_read_filter_row_paeth_ssse3 : png_read_filter_row_paeth_sse2;
+}
+#endif /* PNG_INTEL_FILTERS_SUPPORTED */
+
 static void
 png_init_filter_functions(png_structp pp)
 {
@@ -3685,6 +3934,10 @@ png_init_filter_functions(png_structp pp)
       pp->read_filter[PNG_FILTER_VALUE_PAETH-1] =
          png_read_filter_row_paeth_multibyte_pixel;
 
+#ifdef PNG_INTEL_FILTERS_SUPPORTED
+   png_init_filter_functions_intel(pp, bpp);
+#endif
+
 #ifdef PNG_FILTER_OPTIMIZATIONS
    /* To use this define PNG_FILTER_OPTIMIZATIONS as the name of a function to
     * call to install hardware optimizations for the above functions; simply
@@ -61,6 +61,125 @@ local uLong adler32_combine_ OF((uLong adler1, uLong adler2, z_off64_t len2));
 #  define MOD63(a) a %= BASE
 #endif
 
+#ifdef X86_CHECKSUMS
+
+#include <tmmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#  define TARGET_SSSE3
+#  define TARGET_AVX2
+#else
+#  define TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+local void adler32_ssse3 OF((unsigned long *adler, unsigned long *sum2,
+                             const Bytef *buf, unsigned len));
+local void adler32_avx2 OF((unsigned long *adler, unsigned long *sum2,
+                            const Bytef *buf, unsigned len));
+
+/* Sum of the four 32-bit lanes */
+#define HSUM(v) (v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1)), \
+                 v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e)), \
+                 (unsigned long)(unsigned)_mm_cvtsi128_si32(v))
+
+/*
+  Both of these take len bytes, a multiple of 32, 32 at a time and up to NMAX
+  between modulos.  Over a run of n blocks the first sum gains the bytes, and
+  the second gains 32 times the first sum as it was before each block (kept
+  apart in ps, and starting from adler * n) plus each byte times 32, 31, ...
+  1 by its position in its block.  Lanes may wrap, but the totals fit in 32
+  bits for the same reason as NMAX.
+ */
+local TARGET_SSSE3 void adler32_ssse3(adler, sum2, buf, len)
+    unsigned long *adler;
+    unsigned long *sum2;
+    const Bytef *buf;
+    unsigned len;
+{
+    __m128i tap1, tap2, zero, ones, ps, s1, s2, bytes;
+    unsigned long a = *adler, b = *sum2;
+    unsigned n;
+
+    tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                         24, 23, 22, 21, 20, 19, 18, 17);
+    tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    zero = _mm_setzero_si128();
+    ones = _mm_set1_epi16(1);
+    while (len) {
+        n = len / 32 < NMAX / 32 ? len / 32 : NMAX / 32;
+        len -= n * 32;
+        ps = _mm_cvtsi32_si128((int)(a * n));
+        s1 = zero;
+        s2 = _mm_cvtsi32_si128((int)b);
+        do {
+            ps = _mm_add_epi32(ps, s1);
+            bytes = _mm_loadu_si128((const __m128i *)buf);
+            s1 = _mm_add_epi32(s1, _mm_sad_epu8(bytes, zero));
+            s2 = _mm_add_epi32(s2,
+                    _mm_madd_epi16(_mm_maddubs_epi16(bytes, tap1), ones));
+            bytes = _mm_loadu_si128((const __m128i *)(buf + 16));
+            s1 = _mm_add_epi32(s1, _mm_sad_epu8(bytes, zero));
+            s2 = _mm_add_epi32(s2,
+                    _mm_madd_epi16(_mm_maddubs_epi16(bytes, tap2), ones));
+            buf += 32;
+        } while (--n);
+        s2 = _mm_add_epi32(s2, _mm_slli_epi32(ps, 5));
+        a += HSUM(s1);
+        b = HSUM(s2);
+        MOD(a);
+        MOD(b);
+    }
+    *adler = a;
+    *sum2 = b;
+}
+
+local TARGET_AVX2 void adler32_avx2(adler, sum2, buf, len)
+    unsigned long *adler;
+    unsigned long *sum2;
+    const Bytef *buf;
+    unsigned len;
+{
+    __m256i tap, zero, ones, ps, s1, s2, bytes;
+    __m128i v;
+    unsigned long a = *adler, b = *sum2;
+    unsigned n;
+
+    tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                           24, 23, 22, 21, 20, 19, 18, 17,
+                           16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    zero = _mm256_setzero_si256();
+    ones = _mm256_set1_epi16(1);
+    while (len) {
+        n = len / 32 < NMAX / 32 ? len / 32 : NMAX / 32;
+        len -= n * 32;
+        ps = _mm256_set_epi32(0, 0, 0, 0, 0, 0, 0, (int)(a * n));
+        s1 = zero;
+        s2 = _mm256_set_epi32(0, 0, 0, 0, 0, 0, 0, (int)b);
+        do {
+            ps = _mm256_add_epi32(ps, s1);
+            bytes = _mm256_loadu_si256((const __m256i *)buf);
+            s1 = _mm256_add_epi32(s1, _mm256_sad_epu8(bytes, zero));
+            s2 = _mm256_add_epi32(s2,
+                    _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+            buf += 32;
+        } while (--n);
+        s2 = _mm256_add_epi32(s2, _mm256_slli_epi32(ps, 5));
+        v = _mm_add_epi32(_mm256_castsi256_si128(s1),
+                          _mm256_extracti128_si256(s1, 1));
+        a += HSUM(v);
+        v = _mm_add_epi32(_mm256_castsi256_si128(s2),
+                          _mm256_extracti128_si256(s2, 1));
+        b = HSUM(v);
+        MOD(a);
+        MOD(b);
+    }
+    *adler = a;
+    *sum2 = b;
+}
+
+#endif /* X86_CHECKSUMS */
+
 /* ========================================================================= */
 uLong ZEXPORT adler32(adler, buf, len)
     uLong adler;
@@ -101,6 +220,23 @@ uLong ZEXPORT adler32(adler, buf, len)
         return adler | (sum2 << 16);
     }
 
+#ifdef X86_CHECKSUMS
+    /* whole 32-byte blocks with vector sums, the rest as usual below */
+    if (len >= 64) {
+        int features = x86_cpu_features();
+        unsigned blocks = len & ~31U;
+
+        if (features & X86_AVX2)
+            adler32_avx2(&adler, &sum2, buf, blocks);
+        else if (features & X86_SSSE3)
+            adler32_ssse3(&adler, &sum2, buf, blocks);
+        else
+            blocks = 0;
+        buf += blocks;
+        len -= blocks;
+    }
+#endif /* X86_CHECKSUMS */
+
     /* do length NMAX blocks -- requires just one modulo operation */
     while (len >= NMAX) {
         len -= NMAX;
@@ -322,3 +322,45 @@ void ZLIB_INTERNAL zcfree (opaque, ptr)
 #endif /* MY_ZCALLOC */
 
 #endif /* !Z_SOLO */
+
+#ifdef X86_CHECKSUMS
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+/* Returns the X86_* flags for this CPU */
+int ZLIB_INTERNAL x86_cpu_features()
+{
+#ifdef _MSC_VER
+    static volatile int features = -1;  /* racing threads store the same */
+    int info[4];
+    int found = 0;
+
+    if (features < 0) {
+        __cpuid(info, 1);
+        if (info[2] & (1 << 9))
+            found |= X86_SSSE3;
+        if ((info[2] & (1 << 1)) && (info[3] & (1 << 26)))
+            found |= X86_PCLMUL;
+        /* AVX2 needs OSXSAVE and the OS saving the xmm and ymm state */
+        if ((info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))
+                found |= X86_AVX2;
+        }
+        features = found;
+    }
+    return features;
+#else
+    int found = 0;
+
+    if (__builtin_cpu_supports("ssse3"))
+        found |= X86_SSSE3;
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2"))
+        found |= X86_PCLMUL;
+    if (__builtin_cpu_supports("avx2"))
+        found |= X86_AVX2;
+    return found;
+#endif
+}
+#endif /* X86_CHECKSUMS */
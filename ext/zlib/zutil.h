@@ -249,4 +249,16 @@ extern const char * const z_errmsg[10]; /* indexed by 2-zlib_error */
 #define ZSWAP32(q) ((((q) >> 24) & 0xff) + (((q) >> 8) & 0xff00) + \
                     (((q) & 0xff00) << 8) + (((q) & 0xff) << 24))
 
+/* x86 versions of crc32() and adler32() chosen at run time from what the CPU
+   supports; define NO_X86_CHECKSUMS to leave them out */
+#if !defined(NO_X86_CHECKSUMS) && (defined(__GNUC__) || defined(_MSC_VER)) && \
+    (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+     defined(_M_IX86))
+#  define X86_CHECKSUMS
+#  define X86_SSSE3   1
+#  define X86_PCLMUL  2     /* with SSE2 */
+#  define X86_AVX2    4     /* and the OS saves the ymm registers */
+   int ZLIB_INTERNAL x86_cpu_features OF((void));
+#endif
+
 #endif /* ZUTIL_H */
@@ -0,0 +1,348 @@
+// zbatch: headless scoreboard analysis over a pile of screenshots.
+//
+//   zbatch [-j threads] [-l listfile] [-T trace.json] [-c] [-s|-S] [path ...]
+//
+// Every path is either a PNG or a directory searched recursively for *.png; -l reads one path per
+// line from a file ("-" for stdin). Files are analyzed on a worker pool and each produces one JSON
+// line on stdout as soon as it's done (so lines arrive in completion order, not argument order):
+//
+//   {"file":"images/board1.png","w":1280,"h":800,"scoreBox":[l,t,r,b],"facesBox":[l,t,r,b],
+//    "rows":[[top,bottom],...],"ms":{"decode":..,"scorebox":..,"facesbox":..,"rows":..,"total":..}}
+//
+// Files that fail to load produce {"file":...,"error":"..."} instead. A summary goes to stderr.
+// -T writes a Chrome/Perfetto trace of the run (only in builds with ZILEAN_TRACE, see Makefile).
+// -c adds hardware counters per stage to each line ("counters":{"decode":{"cycles":..},..}) and
+// IPC plus cache/branch misses per pixel to the summary (Linux perf events).
+// -s analyzes each file while it decodes (loadScoreboardStreaming) instead of decoding it whole
+// first; -S also stops decoding a little past the scoreboard's bottom edge. Either way the summary
+// says what fraction of rows were decoded.
+
+#include "zcore.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+// ------------------------------------------------------------------------------------------------
+// Output
+
+typedef struct LineBuffer
+{
+    char *text;
+    size_t length;
+    size_t capacity;
+} LineBuffer;
+
+static void lineAppend(LineBuffer *line, const char *text, size_t length)
+{
+    if(line->length + length + 1 > line->capacity)
+    {
+        line->capacity = (line->length + length + 1) * 2;
+        line->text = realloc(line->text, line->capacity);
+    }
+    memcpy(line->text + line->length, text, length);
+    line->length += length;
+    line->text[line->length] = 0;
+}
+
+static void lineAppendf(LineBuffer *line, const char *format, ...)
+{
+    char temp[256];
+    int length;
+    va_list args;
+    va_start(args, format);
+    length = vsprintf(temp, format, args);
+    va_end(args);
+    lineAppend(line, temp, length);
+}
+
+static void lineAppendString(LineBuffer *line, const char *s)
+{
+    lineAppend(line, "\"", 1);
+    for(; *s; ++s)
+    {
+        unsigned char ch = (unsigned char)*s;
+        if((ch == '"') || (ch == '\\'))
+        {
+            char escaped[2];
+            escaped[0] = '\\';
+            escaped[1] = (char)ch;
+            lineAppend(line, escaped, 2);
+        }
+        else if(ch < 0x20)
+        {
+            char escaped[8];
+            sprintf(escaped, "\\u%04x", ch);
+            lineAppend(line, escaped, 6);
+        }
+        else
+        {
+            lineAppend(line, (const char *)&ch, 1);
+        }
+    }
+    lineAppend(line, "\"", 1);
+}
+
+static void lineAppendRect(LineBuffer *line, RECT *r)
+{
+    lineAppendf(line, "[%d,%d,%d,%d]", r->left, r->top, r->right, r->bottom);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Analysis
+
+typedef struct Batch
+{
+    zFileList files;
+    zBitmapPool *bitmapPool;
+    zMutex outputLock;
+    int failures;
+    int counters;
+    int streamFlags;            // -1 for whole-image decoding
+    double rowsDecoded;
+    double rowsTotal;
+    double stageTotals[Z_STAGE_COUNT];
+    double counterTotals[Z_STAGE_COUNT][Z_COUNTER_COUNT];
+    double pixelTotal;
+} Batch;
+
+static void analyzeFile(void *context, int index)
+{
+    Batch *batch = (Batch *)context;
+    const char *file = batch->files.names[index];
+    LineBuffer line = { 0 };
+    zScoreboardInfo info;
+    zStreamStats stats;
+    zBitmap *zbmp = NULL;
+    zStageMark mark;
+    double start = zTimeNow();
+    double pixels = 0.0;
+    int loaded;
+    int i, k;
+
+    zTraceBegin("analyzeFile");
+    if(batch->streamFlags >= 0)
+    {
+        loaded = loadScoreboardStreaming(file, batch->streamFlags, &info, &stats);
+    }
+    else
+    {
+        zStageBegin(&mark);
+        zbmp = loadScoreboardPooled(file, batch->bitmapPool);
+        zStageEnd(&mark, &info, Z_STAGE_DECODE);
+        loaded = (zbmp != NULL);
+        if(zbmp)
+        {
+            findScoreboard(zbmp, NULL, NULL, &info);
+            stats.w = zbmp->w;
+            stats.h = zbmp->h;
+            stats.rowsDecoded = zbmp->h;
+            zBitmapPoolRelease(batch->bitmapPool, zbmp);
+        }
+    }
+
+    lineAppend(&line, "{\"file\":", 8);
+    lineAppendString(&line, file);
+    if(loaded)
+    {
+        lineAppendf(&line, ",\"w\":%d,\"h\":%d", stats.w, stats.h);
+        lineAppend(&line, ",\"scoreBox\":", 12);
+        lineAppendRect(&line, &info.scoreBox);
+        lineAppend(&line, ",\"facesBox\":", 12);
+        lineAppendRect(&line, &info.facesBox);
+        lineAppend(&line, ",\"rows\":[", 9);
+        for(i = 0; i < info.rowCount; ++i)
+        {
+            lineAppendf(&line, i ? ",[%d,%d]" : "[%d,%d]", info.rows[i].top, info.rows[i].bottom);
+        }
+        lineAppend(&line, "],\"ms\":{", 8);
+        for(i = 0; i < Z_STAGE_COUNT; ++i)
+        {
+            lineAppendString(&line, zStageNames[i]);
+            lineAppendf(&line, ":%.3f,", info.stageMs[i]);
+        }
+        lineAppendf(&line, "\"total\":%.3f}", zTimeNow() - start);
+        if(batch->counters)
+        {
+            lineAppend(&line, ",\"counters\":{", 13);
+            for(i = 0; i < Z_STAGE_COUNT; ++i)
+            {
+                lineAppend(&line, i ? "," : "", i ? 1 : 0);
+                lineAppendString(&line, zStageNames[i]);
+                for(k = 0; k < Z_COUNTER_COUNT; ++k)
+                {
+                    lineAppend(&line, k ? "," : ":{", k ? 1 : 2);
+                    lineAppendString(&line, zCounterNames[k]);
+                    lineAppendf(&line, ":%llu", info.stageCounters[i][k]);
+                }
+                lineAppend(&line, "}", 1);
+            }
+            lineAppend(&line, "}", 1);
+        }
+        lineAppend(&line, "}\n", 2);
+
+        pixels = (double)stats.w * stats.h;
+    }
+    else
+    {
+        lineAppend(&line, ",\"error\":\"load failed\"}\n", 24);
+    }
+
+    zMutexLock(&batch->outputLock);
+    fputs(line.text, stdout);
+    fflush(stdout);
+    if(loaded)
+    {
+        for(i = 0; i < Z_STAGE_COUNT; ++i)
+        {
+            batch->stageTotals[i] += info.stageMs[i];
+            for(k = 0; k < Z_COUNTER_COUNT; ++k)
+            {
+                batch->counterTotals[i][k] += (double)info.stageCounters[i][k];
+            }
+        }
+        batch->pixelTotal += pixels;
+        batch->rowsDecoded += stats.rowsDecoded;
+        batch->rowsTotal += stats.h;
+    }
+    else
+    {
+        ++batch->failures;
+    }
+    zMutexUnlock(&batch->outputLock);
+    free(line.text);
+    zTraceEnd();
+}
+
+// ------------------------------------------------------------------------------------------------
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: zbatch [-j threads] [-l listfile|-] [-T trace.json] [-c] [-s|-S] [path ...]\n");
+    fprintf(stderr, "  paths may be PNG files or directories (searched recursively for *.png)\n");
+}
+
+int main(int argc, char **argv)
+{
+    Batch batch;
+    zWorkerPool *pool;
+    int threadCount = 0;
+    const char *traceFile = NULL;
+    double start;
+    double elapsed;
+    int analyzed;
+    int i;
+
+    memset(&batch, 0, sizeof(Batch));
+    batch.streamFlags = -1;
+    for(i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-j") && (i + 1 < argc))
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-l") && (i + 1 < argc))
+        {
+            if(!zFileListAddListFile(&batch.files, argv[++i]))
+            {
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-T") && (i + 1 < argc))
+        {
+            traceFile = argv[++i];
+        }
+        else if(!strcmp(argv[i], "-c"))
+        {
+            batch.counters = 1;
+        }
+        else if(!strcmp(argv[i], "-s"))
+        {
+            batch.streamFlags = 0;
+        }
+        else if(!strcmp(argv[i], "-S"))
+        {
+            batch.streamFlags = Z_STREAM_EARLY_STOP;
+        }
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            zFileListAddPath(&batch.files, argv[i]);
+        }
+    }
+    if(batch.files.count == 0)
+    {
+        usage();
+        return 1;
+    }
+    zFileListSort(&batch.files);
+
+    zSetVerbose(0);
+    // files already decode one per thread, so striped PNGs fanning out too would only oversubscribe
+    zSetPngStripThreads(1);
+    zScoreboardInit();
+    if(traceFile)
+    {
+        zTraceSetEnabled(1);
+    }
+    if(batch.counters && !zCountersEnable())
+    {
+        fprintf(stderr, "hardware counters unavailable (needs Linux perf events; check perf_event_paranoid)\n");
+        batch.counters = 0;
+    }
+    pool = zWorkerPoolCreate(threadCount);
+    batch.bitmapPool = zBitmapPoolCreate(pool->threadCount);
+    zMutexInit(&batch.outputLock);
+
+    start = zTimeNow();
+    zWorkerPoolRun(pool, analyzeFile, &batch, batch.files.count);
+    elapsed = zTimeNow() - start;
+
+    analyzed = batch.files.count - batch.failures;
+    fprintf(stderr, "%d files (%d failed) in %.1f ms on %d threads, %.1f files/s\n",
+        batch.files.count, batch.failures, elapsed, pool->threadCount,
+        (elapsed > 0.0) ? (batch.files.count * 1000.0 / elapsed) : 0.0);
+    if(analyzed > 0)
+    {
+        fprintf(stderr, "mean ms per file:");
+        for(i = 0; i < Z_STAGE_COUNT; ++i)
+        {
+            fprintf(stderr, " %s %.3f", zStageNames[i], batch.stageTotals[i] / analyzed);
+        }
+        fprintf(stderr, "\n");
+    }
+    if((batch.streamFlags >= 0) && (batch.rowsTotal > 0.0))
+    {
+        fprintf(stderr, "streamed: %.1f%% of rows decoded\n", 100.0 * batch.rowsDecoded / batch.rowsTotal);
+    }
+    if(batch.counters && (batch.pixelTotal > 0.0))
+    {
+        for(i = 0; i < Z_STAGE_COUNT; ++i)
+        {
+            double *totals = batch.counterTotals[i];
+            fprintf(stderr, "%-9s IPC %.2f, %.1f instructions/px, %.4f cache misses/px, %.4f branch misses/px\n",
+                zStageNames[i],
+                (totals[Z_COUNTER_CYCLES] > 0.0) ? (totals[Z_COUNTER_INSTRUCTIONS] / totals[Z_COUNTER_CYCLES]) : 0.0,
+                totals[Z_COUNTER_INSTRUCTIONS] / batch.pixelTotal,
+                totals[Z_COUNTER_CACHE_MISSES] / batch.pixelTotal,
+                totals[Z_COUNTER_BRANCH_MISSES] / batch.pixelTotal);
+        }
+    }
+
+    if(traceFile && !zTraceDump(traceFile))
+    {
+        fprintf(stderr, "couldn't write trace %s (tracing needs a ZILEAN_TRACE build)\n", traceFile);
+    }
+
+    zMutexDestroy(&batch.outputLock);
+    zBitmapPoolDestroy(batch.bitmapPool);
+    zWorkerPoolDestroy(pool);
+    zFileListFree(&batch.files);
+    zPngShutdown();
+    return (batch.failures > 0) ? 2 : 0;
+}
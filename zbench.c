@@ -0,0 +1,530 @@
+// zbench: microbenchmarks for the per-pixel kernels and the loader.
+//
+//   zbench [-i imagedir] [-s samples] [-w warmupms] [-t samplems] [-k scalar|sse2|avx2] [filter]
+//
+// Every benchmark runs over images/board1..3.png plus synthetic frames at a few common client
+// resolutions. Each case is warmed up, then timed as a number of samples that are each long enough
+// to swamp timer resolution. Reported per frame: mean ns with a 95% confidence interval, cycles
+// per pixel (TSC cycles on x86, so reference cycles rather than core cycles) and MB/s of pixels
+// touched. A filter argument only runs benchmarks whose name contains it.
+
+#include "zcore.h"
+#include "zlib.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ZBENCH_TSC
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define ZBENCH_TSC
+#endif
+
+static unsigned long long cycleNow(void)
+{
+#ifdef ZBENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+// Frames
+
+typedef struct BenchFrame
+{
+    char name[64];
+    char path[512];     // empty for synthetic frames
+    zBitmap *source;    // never written to
+    zBitmap *scratch;   // for benchmarks that modify pixels
+} BenchFrame;
+
+#define MAX_FRAMES 16
+
+static BenchFrame sFrames[MAX_FRAMES];
+static int sFrameCount = 0;
+
+static void addFrame(const char *name, const char *path, zBitmap *zbmp)
+{
+    BenchFrame *frame = &sFrames[sFrameCount++];
+    strncpy(frame->name, name, sizeof(frame->name) - 1);
+    if(path)
+    {
+        strncpy(frame->path, path, sizeof(frame->path) - 1);
+    }
+    frame->source = zbmp;
+    frame->scratch = zBitmapCreate(zbmp->w, zbmp->h);
+    memcpy(frame->scratch->pixels, zbmp->pixels, zbmp->w * zbmp->h * sizeof(Pixel));
+}
+
+// The synthetic frames are zSyntheticScoreboardCreate's noise with a scoreboard outline and a column
+// of champion boxes, so the searches have something to find and the match kernels see a realistic
+// mix of hits and misses.
+static void loadFrames(const char *imageDir)
+{
+    static const int sizes[][2] = { { 1024, 768 }, { 1280, 800 }, { 1920, 1080 }, { 2560, 1440 } };
+    char path[512];
+    char name[64];
+    int i;
+
+    for(i = 1; i <= 3; ++i)
+    {
+        zBitmap *zbmp;
+        sprintf(path, "%s/board%d.png", imageDir, i);
+        zbmp = loadScoreboard(path);
+        if(zbmp)
+        {
+            sprintf(name, "board%d", i);
+            addFrame(name, path, zbmp);
+        }
+    }
+    for(i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); ++i)
+    {
+        sprintf(name, "synth%dx%d", sizes[i][0], sizes[i][1]);
+        addFrame(name, NULL, zSyntheticScoreboardCreate(sizes[i][0], sizes[i][1]));
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Benchmarks
+//
+// Each one processes a whole frame per call and returns something derived from the result so the
+// work can't be optimized away.
+
+static Pixel sScoreColors[4];
+static struct ColorList sScoreColorList;
+static volatile int sSink;
+
+static int benchPixelMatches(BenchFrame *frame)
+{
+    int count = 0;
+    int i;
+    int pixelCount = frame->source->w * frame->source->h;
+    Pixel *pixels = frame->source->pixels;
+    for(i = 0; i < pixelCount; ++i)
+    {
+        count += pixelMatches(&pixels[i], 33, 69, 61, 4);
+    }
+    return count;
+}
+
+static int benchPixelMatchesColors(BenchFrame *frame)
+{
+    int count = 0;
+    int i;
+    int pixelCount = frame->source->w * frame->source->h;
+    Pixel *pixels = frame->source->pixels;
+    for(i = 0; i < pixelCount; ++i)
+    {
+        count += pixelMatchesColors(&pixels[i], &sScoreColorList);
+    }
+    return count;
+}
+
+static int benchPixelIsAGray(BenchFrame *frame)
+{
+    int count = 0;
+    int i;
+    int pixelCount = frame->source->w * frame->source->h;
+    Pixel *pixels = frame->source->pixels;
+    for(i = 0; i < pixelCount; ++i)
+    {
+        count += pixelIsAGray(&pixels[i], &gChampBoxGray);
+    }
+    return count;
+}
+
+static int benchFindBox(BenchFrame *frame)
+{
+    RECT box;
+    zBitmapFindBox(frame->source, NULL, pixelMatchesColors, &sScoreColorList, 0.5f, 0.9f, &box, 0);
+    return box.left + box.top + box.right + box.bottom;
+}
+
+// the scoreboard and champion-box searches over the same frame, separately and in one fused pass
+static int benchFindBoxPair(BenchFrame *frame)
+{
+    RECT scoreBox, grayBox;
+    zBitmapFindBox(frame->source, NULL, pixelMatchesColors, &sScoreColorList, 0.5f, 0.9f, &scoreBox, 0);
+    zBitmapFindBox(frame->source, NULL, pixelIsAGray, &gChampBoxGray, 0.5f, 0.9f, &grayBox, 0);
+    return scoreBox.left + grayBox.left;
+}
+
+static int benchFindBoxes(BenchFrame *frame)
+{
+    zFindBoxQuery queries[2];
+    memset(queries, 0, sizeof(queries));
+    queries[0].func = pixelMatchesColors;
+    queries[0].userdata = &sScoreColorList;
+    queries[1].func = pixelIsAGray;
+    queries[1].userdata = &gChampBoxGray;
+    queries[0].lineToleranceX = queries[1].lineToleranceX = 0.5f;
+    queries[0].lineToleranceY = queries[1].lineToleranceY = 0.9f;
+    zBitmapFindBoxes(frame->source, queries, 2);
+    return queries[0].outputRect.left + queries[1].outputRect.left;
+}
+
+// the same search split by rows across one thread per CPU
+static int benchFindBoxParallel(BenchFrame *frame)
+{
+    static zWorkerPool *pool = NULL;
+    RECT box;
+    if(!pool)
+    {
+        pool = zWorkerPoolCreate(0);
+    }
+    zBitmapFindBoxParallel(pool, frame->source, NULL, pixelMatchesColors, &sScoreColorList, 0.5f, 0.9f, &box);
+    return box.left + box.top + box.right + box.bottom;
+}
+
+// 16 overlapping half-frame probes, the kind of repeated candidate-region search a match table is
+// for: once with zBitmapFindBox each, once from a single zMatchTable (its build included)
+#define PROBE_COUNT 16
+
+static void probeRect(BenchFrame *frame, int k, RECT *rect)
+{
+    rect->left = (k % 4) * frame->source->w / 8;
+    rect->top = (k / 4) * frame->source->h / 8;
+    rect->right = rect->left + frame->source->w / 2;
+    rect->bottom = rect->top + frame->source->h / 2;
+}
+
+static int benchFindBoxProbes(BenchFrame *frame)
+{
+    RECT rect, box;
+    int sum = 0;
+    int k;
+    for(k = 0; k < PROBE_COUNT; ++k)
+    {
+        probeRect(frame, k, &rect);
+        zBitmapFindBox(frame->source, &rect, pixelMatchesColors, &sScoreColorList, 0.5f, 0.9f, &box, 0);
+        sum += box.left + box.top + box.right + box.bottom;
+    }
+    return sum;
+}
+
+static int benchMatchTableProbes(BenchFrame *frame)
+{
+    RECT rect, box;
+    int sum = 0;
+    int k;
+    zMatchTable *table = zMatchTableCreate(frame->source, pixelMatchesColors, &sScoreColorList);
+    for(k = 0; k < PROBE_COUNT; ++k)
+    {
+        probeRect(frame, k, &rect);
+        zMatchTableFindBox(table, &rect, 0.5f, 0.9f, &box);
+        sum += box.left + box.top + box.right + box.bottom;
+    }
+    zMatchTableDestroy(table);
+    return sum;
+}
+
+static int benchGrayscale(BenchFrame *frame)
+{
+    // grayscale is idempotent, so after the first call this measures the same work every time
+    zBitmapGrayscale(frame->scratch, NULL);
+    return frame->scratch->pixels[0].r;
+}
+
+static int benchFill(BenchFrame *frame)
+{
+    zBitmapFill(frame->scratch, NULL, 12, 34, 56);
+    return frame->scratch->pixels[0].g;
+}
+
+static int benchFrameDiff(BenchFrame *frame)
+{
+    // every call hashes the whole frame; an unchanged frame just comes back with nothing changed
+    static zFrameDiff *diff = NULL;
+    if(!diff)
+    {
+        diff = zFrameDiffCreate();
+    }
+    return zFrameDiffUpdate(diff, frame->source);
+}
+
+static int benchLoadScoreboard(BenchFrame *frame)
+{
+    zBitmap *zbmp = loadScoreboard(frame->path);
+    int w = zbmp ? zbmp->w : 0;
+    if(zbmp)
+    {
+        zBitmapDestroy(zbmp);
+    }
+    return w;
+}
+
+// the same load with the 8-bit RGB fast path turned off, for comparison
+static int benchLoadScoreboardLibpng(BenchFrame *frame)
+{
+    int w;
+    zSetPngFastPath(0);
+    w = benchLoadScoreboard(frame);
+    zSetPngFastPath(1);
+    return w;
+}
+
+// the fast path split across the inflate and unfilter threads, whatever the CPU count
+static int benchLoadScoreboardPipelined(BenchFrame *frame)
+{
+    int w;
+    zSetPngPipeline(1);
+    w = benchLoadScoreboard(frame);
+    zSetPngPipeline(0);
+    return w;
+}
+
+// the checksums zlib and libpng run over every decoded and compressed byte
+static int benchCrc32(BenchFrame *frame)
+{
+    return (int)crc32(0L, (const Bytef *)frame->source->pixels, frame->source->w * frame->source->h * sizeof(Pixel));
+}
+
+static int benchAdler32(BenchFrame *frame)
+{
+    return (int)adler32(1L, (const Bytef *)frame->source->pixels, frame->source->w * frame->source->h * sizeof(Pixel));
+}
+
+typedef struct Benchmark
+{
+    const char *name;
+    int (*run)(BenchFrame *frame);
+    int needsFile;
+} Benchmark;
+
+static const Benchmark sBenchmarks[] =
+{
+    { "pixelMatches",       benchPixelMatches,       0 },
+    { "pixelMatchesColors", benchPixelMatchesColors, 0 },
+    { "pixelIsAGray",       benchPixelIsAGray,       0 },
+    { "zBitmapFindBox",     benchFindBox,            0 },
+    { "zBitmapFindBoxParallel", benchFindBoxParallel, 0 },
+    { "findBoxPair",        benchFindBoxPair,        0 },
+    { "zBitmapFindBoxes",   benchFindBoxes,          0 },
+    { "findBoxProbes16",    benchFindBoxProbes,      0 },
+    { "matchTableProbes16", benchMatchTableProbes,   0 },
+    { "zBitmapGrayscale",   benchGrayscale,          0 },
+    { "zBitmapFill",        benchFill,               0 },
+    { "zFrameDiffUpdate",   benchFrameDiff,          0 },
+    { "crc32",              benchCrc32,              0 },
+    { "adler32",            benchAdler32,            0 },
+    { "loadScoreboard",     benchLoadScoreboard,     1 },
+    { "loadScoreboardLibpng", benchLoadScoreboardLibpng, 1 },
+    { "loadScoreboardPipelined", benchLoadScoreboardPipelined, 1 },
+};
+
+// ------------------------------------------------------------------------------------------------
+// Measurement
+
+typedef struct BenchOptions
+{
+    int samples;
+    double warmupMs;
+    double sampleMs;
+} BenchOptions;
+
+typedef struct BenchResult
+{
+    double meanNs;      // per frame
+    double ci95Ns;      // half-width of the 95% interval on meanNs
+    double cyclesPerFrame;
+} BenchResult;
+
+// two-sided 95% Student t for df = 1..30; larger df use the normal value
+static double studentT95(int df)
+{
+    static const double table[30] =
+    {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if(df < 1)
+    {
+        return 0.0;
+    }
+    return (df <= 30) ? table[df - 1] : 1.960;
+}
+
+static void measure(const Benchmark *bench, BenchFrame *frame, BenchOptions *options, BenchResult *result)
+{
+    double *sampleNs = calloc(options->samples, sizeof(double));
+    double start;
+    double elapsed;
+    double sum = 0.0;
+    double variance = 0.0;
+    unsigned long long cycles = 0;
+    int iterations = 0;
+    int perSample;
+    int s, k;
+
+    // warm up (caches, page faults, branch predictors) and size the samples while at it
+    start = zTimeNow();
+    do
+    {
+        sSink += bench->run(frame);
+        ++iterations;
+        elapsed = zTimeNow() - start;
+    } while(elapsed < options->warmupMs);
+    perSample = (int)(options->sampleMs / (elapsed / iterations));
+    if(perSample < 1)
+    {
+        perSample = 1;
+    }
+
+    for(s = 0; s < options->samples; ++s)
+    {
+        unsigned long long c = cycleNow();
+        start = zTimeNow();
+        for(k = 0; k < perSample; ++k)
+        {
+            sSink += bench->run(frame);
+        }
+        sampleNs[s] = (zTimeNow() - start) * 1000000.0 / perSample;
+        cycles += cycleNow() - c;
+        sum += sampleNs[s];
+    }
+
+    result->meanNs = sum / options->samples;
+    for(s = 0; s < options->samples; ++s)
+    {
+        double d = sampleNs[s] - result->meanNs;
+        variance += d * d;
+    }
+    if(options->samples > 1)
+    {
+        variance /= (options->samples - 1);
+    }
+    result->ci95Ns = studentT95(options->samples - 1) * sqrt(variance / options->samples);
+    result->cyclesPerFrame = (double)cycles / ((double)options->samples * perSample);
+    free(sampleNs);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: zbench [-i imagedir] [-s samples] [-w warmupms] [-t samplems] [-k scalar|sse2|avx2] [filter]\n");
+}
+
+int main(int argc, char **argv)
+{
+    static const char *levelNames[] = { "scalar", "sse2", "avx2" };
+    const char *imageDir = "images";
+    const char *filter = NULL;
+    BenchOptions options;
+    int level = -1;
+    int b, f, i;
+
+    options.samples = 20;
+    options.warmupMs = 100.0;
+    options.sampleMs = 10.0;
+    for(i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-i") && (i + 1 < argc))
+        {
+            imageDir = argv[++i];
+        }
+        else if(!strcmp(argv[i], "-s") && (i + 1 < argc))
+        {
+            options.samples = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-w") && (i + 1 < argc))
+        {
+            options.warmupMs = atof(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-t") && (i + 1 < argc))
+        {
+            options.sampleMs = atof(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-k") && (i + 1 < argc))
+        {
+            ++i;
+            for(level = Z_KERNEL_AVX2; level >= Z_KERNEL_SCALAR; --level)
+            {
+                if(!strcmp(argv[i], levelNames[level]))
+                {
+                    break;
+                }
+            }
+            if(level < 0)
+            {
+                usage();
+                return 1;
+            }
+        }
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            filter = argv[i];
+        }
+    }
+    if(options.samples < 2)
+    {
+        options.samples = 2;
+    }
+
+    zSetVerbose(0);
+    if(level >= 0)
+    {
+        zSetKernelLevel(level);
+    }
+    pixelSet(&sScoreColors[0], 24, 63, 60, 4);
+    pixelSet(&sScoreColors[1], 33, 69, 61, 4);
+    pixelSet(&sScoreColors[2], 31, 63, 59, 7);
+    pixelSet(&sScoreColors[3], 34, 74, 64, 3);
+    sScoreColorList.colors = sScoreColors;
+    sScoreColorList.count = 4;
+
+    loadFrames(imageDir);
+    printf("kernel level %s, %d samples of ~%.0f ms after %.0f ms warmup\n",
+        levelNames[zGetKernelLevel()], options.samples, options.sampleMs, options.warmupMs);
+    printf("%-24s %-16s %14s %10s %10s %10s\n", "benchmark", "frame", "ns/frame", "+/-95%", "cyc/px", "MB/s");
+
+    for(b = 0; b < (int)(sizeof(sBenchmarks) / sizeof(sBenchmarks[0])); ++b)
+    {
+        const Benchmark *bench = &sBenchmarks[b];
+        if(filter && !strstr(bench->name, filter))
+        {
+            continue;
+        }
+        for(f = 0; f < sFrameCount; ++f)
+        {
+            BenchFrame *frame = &sFrames[f];
+            BenchResult result;
+            double pixelCount = (double)frame->source->w * frame->source->h;
+            if(bench->needsFile && !frame->path[0])
+            {
+                continue;
+            }
+            measure(bench, frame, &options, &result);
+            printf("%-24s %-16s %14.0f %10.0f ", bench->name, frame->name, result.meanNs, result.ci95Ns);
+            if(result.cyclesPerFrame > 0.0)
+            {
+                printf("%10.3f ", result.cyclesPerFrame / pixelCount);
+            }
+            else
+            {
+                printf("%10s ", "-");
+            }
+            printf("%10.1f\n", (pixelCount * sizeof(Pixel) / (1024.0 * 1024.0)) / (result.meanNs / 1000000000.0));
+        }
+    }
+
+    for(f = 0; f < sFrameCount; ++f)
+    {
+        zBitmapDestroy(sFrames[f].source);
+        zBitmapDestroy(sFrames[f].scratch);
+    }
+    zPngShutdown();
+    return 0;
+}
@@ -0,0 +1,5261 @@
+#include "zcore.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <limits.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define ZILEAN_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ZILEAN_TARGET_SSE2
+#define ZILEAN_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define ZILEAN_TARGET_SSE2 __attribute__((target("sse2")))
+#define ZILEAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#include "png.h"
+#include "zlib.h"
+
+void pixelSet(Pixel *pixel, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    pixel->r = r;
+    pixel->g = g;
+    pixel->b = b;
+    pixel->a = a;
+}
+
+int pixelMatches(Pixel *pixel, unsigned char r, unsigned char g, unsigned char b, unsigned char tolerance)
+{
+    if(pixel->r > (r + tolerance)) return 0;
+    if(pixel->r < (r - tolerance)) return 0;
+    if(pixel->g > (g + tolerance)) return 0;
+    if(pixel->g < (g - tolerance)) return 0;
+    if(pixel->b > (b + tolerance)) return 0;
+    if(pixel->b < (b - tolerance)) return 0;
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Generic helpers
+
+void inflateRect(RECT *r, int i, int w, int h)
+{
+    r->left   -= i;
+    r->top    -= i;
+    r->right  += i;
+    r->bottom += i;
+    if(r->left < 0)   r->left = 0;
+    if(r->top < 0)    r->top = 0;
+    if(r->right > w)  r->right = w;
+    if(r->bottom > h) r->bottom = h;
+}
+
+int closeEnough(int a, int b, int epsilon)
+{
+    int diff = a - b;
+    if(diff < 0)
+    {
+        diff *= -1;
+    }
+    if(diff <= epsilon)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Logging and timing
+
+static int sVerbose = 1;
+
+void zSetVerbose(int verbose)
+{
+    sVerbose = verbose;
+}
+
+static void zLog(const char *format, ...)
+{
+    va_list args;
+    if(!sVerbose)
+    {
+        return;
+    }
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+double zTimeNow(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER now;
+    if(!frequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+// Tracing
+//
+// Each thread that records a zone gets a zTraceBuffer on first use, pushed onto a global list with
+// a compare-and-swap so registration never takes a lock either. Open zones live on a small stack;
+// closing one writes a single complete event (start + duration) into the ring, overwriting the
+// oldest once it wraps. Only the owning thread writes a buffer.
+
+#ifdef _MSC_VER
+#define ZILEAN_THREAD_LOCAL __declspec(thread)
+#else
+#define ZILEAN_THREAD_LOCAL __thread
+#endif
+
+#define TRACE_RING_SIZE (1 << 16) // events per thread, power of two
+#define TRACE_MAX_DEPTH 32
+
+typedef struct zTraceEvent
+{
+    const char *name;
+    double start;   // ms, zTimeNow
+    double duration;
+} zTraceEvent;
+
+typedef struct zTraceBuffer
+{
+    struct zTraceBuffer *next;
+    int threadIndex;
+    volatile unsigned int head; // events ever written; the ring holds the last TRACE_RING_SIZE
+    int depth;
+    zTraceEvent open[TRACE_MAX_DEPTH];
+    zTraceEvent *events;
+} zTraceBuffer;
+
+static volatile int sTraceEnabled = 0;
+static double sTraceEpoch = 0.0;
+static zTraceBuffer * volatile sTraceBuffers = NULL;
+static volatile int sTraceThreadCount = 0;
+static ZILEAN_THREAD_LOCAL zTraceBuffer *sThreadTrace = NULL;
+
+static zTraceBuffer * traceThreadBuffer(void)
+{
+    zTraceBuffer *buffer = sThreadTrace;
+    if(!buffer)
+    {
+        buffer = calloc(1, sizeof(zTraceBuffer));
+        buffer->events = calloc(TRACE_RING_SIZE, sizeof(zTraceEvent));
+        buffer->threadIndex = zAtomicIncrement(&sTraceThreadCount);
+        do
+        {
+            buffer->next = sTraceBuffers;
+        } while(!zAtomicCasPointer(&sTraceBuffers, buffer->next, buffer));
+        sThreadTrace = buffer;
+    }
+    return buffer;
+}
+
+void zTraceBeginZone(const char *name)
+{
+    zTraceBuffer *buffer;
+    if(!sTraceEnabled)
+    {
+        return;
+    }
+    buffer = traceThreadBuffer();
+    if(buffer->depth < TRACE_MAX_DEPTH)
+    {
+        buffer->open[buffer->depth].name = name;
+        buffer->open[buffer->depth].start = zTimeNow();
+    }
+    ++buffer->depth;
+}
+
+void zTraceEndZone(void)
+{
+    zTraceBuffer *buffer = sThreadTrace;
+    if(!buffer || (buffer->depth == 0))
+    {
+        return;
+    }
+    --buffer->depth;
+    if(buffer->depth < TRACE_MAX_DEPTH)
+    {
+        zTraceEvent *open = &buffer->open[buffer->depth];
+        zTraceEvent *event = &buffer->events[buffer->head & (TRACE_RING_SIZE - 1)];
+        event->name = open->name;
+        event->start = open->start;
+        event->duration = zTimeNow() - open->start;
+        ++buffer->head;
+    }
+}
+
+void zTraceSetEnabled(int enabled)
+{
+    if(enabled && (sTraceEpoch == 0.0))
+    {
+        sTraceEpoch = zTimeNow();
+    }
+    sTraceEnabled = enabled;
+}
+
+int zTraceDump(const char *filename)
+{
+#ifdef ZILEAN_TRACE
+    zTraceBuffer *buffer;
+    int first = 1;
+    FILE *f = fopen(filename, "w");
+    if(!f)
+    {
+        return 0;
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for(buffer = sTraceBuffers; buffer; buffer = buffer->next)
+    {
+        unsigned int head = buffer->head;
+        unsigned int i = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            first ? "" : ",", buffer->threadIndex, buffer->threadIndex);
+        first = 0;
+        for(; i < head; ++i)
+        {
+            zTraceEvent *event = &buffer->events[i & (TRACE_RING_SIZE - 1)];
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                event->name, buffer->threadIndex, (event->start - sTraceEpoch) * 1000.0, event->duration * 1000.0);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return 1;
+#else
+    (void)filename;
+    return 0;
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+// Threads and worker pool
+//
+// zWorkerPoolRun() calls func(context, index) for every index in [0, count) spread across the
+// pool's threads, and returns once all of them are done. The calling thread works too, so a pool
+// created with a thread count of 1 simply runs everything inline.
+
+typedef struct zThreadStart
+{
+    zThreadFunc func;
+    void *arg;
+} zThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI threadTrampoline(LPVOID param)
+#else
+static void * threadTrampoline(void *param)
+#endif
+{
+    zThreadStart start = *(zThreadStart *)param;
+    free(param);
+    start.func(start.arg);
+    return 0;
+}
+
+int zThreadCreate(zThread *thread, zThreadFunc func, void *arg)
+{
+    zThreadStart *start = calloc(1, sizeof(zThreadStart));
+    start->func = func;
+    start->arg = arg;
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, threadTrampoline, start, 0, NULL);
+    if(*thread == NULL)
+#else
+    if(pthread_create(thread, NULL, threadTrampoline, start) != 0)
+#endif
+    {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void zThreadJoin(zThread thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+int zCpuCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+#endif
+}
+
+void zSleepMs(double ms)
+{
+    if(ms <= 0.0)
+    {
+        return;
+    }
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    {
+        struct timespec duration;
+        duration.tv_sec = (time_t)(ms / 1000.0);
+        duration.tv_nsec = (long)((ms - (duration.tv_sec * 1000.0)) * 1000000.0);
+        nanosleep(&duration, NULL);
+    }
+#endif
+}
+
+// takes indices until the current batch is exhausted; called with the lock held, returns with it held
+static void workerPoolDrain(zWorkerPool *pool)
+{
+    while(pool->nextIndex < pool->count)
+    {
+        int index = pool->nextIndex++;
+        zWorkFunc func = pool->func;
+        void *context = pool->context;
+        zMutexUnlock(&pool->lock);
+        func(context, index);
+        zMutexLock(&pool->lock);
+        if(--pool->pending == 0)
+        {
+            zCondBroadcast(&pool->done);
+        }
+    }
+}
+
+static void workerPoolThread(void *arg)
+{
+    zWorkerPool *pool = (zWorkerPool *)arg;
+    zMutexLock(&pool->lock);
+    while(!pool->quit)
+    {
+        workerPoolDrain(pool);
+        if(!pool->quit)
+        {
+            zCondWait(&pool->wake, &pool->lock);
+        }
+    }
+    zMutexUnlock(&pool->lock);
+}
+
+// threadCount <= 0 means one thread per CPU
+zWorkerPool * zWorkerPoolCreate(int threadCount)
+{
+    int i;
+    zWorkerPool *pool = calloc(1, sizeof(zWorkerPool));
+    if(threadCount <= 0)
+    {
+        threadCount = zCpuCount();
+    }
+    zMutexInit(&pool->lock);
+    zCondInit(&pool->wake);
+    zCondInit(&pool->done);
+    pool->threadCount = 1;
+    pool->threads = calloc(threadCount, sizeof(zThread));
+    for(i = 1; i < threadCount; ++i)
+    {
+        if(!zThreadCreate(&pool->threads[i], workerPoolThread, pool))
+        {
+            break;
+        }
+        ++pool->threadCount;
+    }
+    return pool;
+}
+
+void zWorkerPoolDestroy(zWorkerPool *pool)
+{
+    int i;
+    zMutexLock(&pool->lock);
+    pool->quit = 1;
+    zCondBroadcast(&pool->wake);
+    zMutexUnlock(&pool->lock);
+    for(i = 1; i < pool->threadCount; ++i)
+    {
+        zThreadJoin(pool->threads[i]);
+    }
+    zCondDestroy(&pool->wake);
+    zCondDestroy(&pool->done);
+    zMutexDestroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+// not reentrant: one batch at a time per pool
+void zWorkerPoolRun(zWorkerPool *pool, zWorkFunc func, void *context, int count)
+{
+    zMutexLock(&pool->lock);
+    pool->func = func;
+    pool->context = context;
+    pool->nextIndex = 0;
+    pool->count = count;
+    pool->pending = count;
+    zCondBroadcast(&pool->wake);
+    workerPoolDrain(pool);
+    while(pool->pending > 0)
+    {
+        zCondWait(&pool->done, &pool->lock);
+    }
+    zMutexUnlock(&pool->lock);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Returns NULL if the pixels can't be allocated
+zBitmap * zBitmapCreate(int w, int h)
+{
+    zBitmap * bmp = calloc(1, sizeof(zBitmap));
+    size_t count = (size_t)w * (size_t)h;
+    bmp->w = w;
+    bmp->h = h;
+#ifdef _WIN32
+    bmp->pixels = VirtualAlloc(NULL, count * sizeof(unsigned int), MEM_COMMIT, PAGE_READWRITE);
+#else
+    bmp->pixels = calloc(count, sizeof(unsigned int));
+#endif
+    if(!bmp->pixels)
+    {
+        free(bmp);
+        return NULL;
+    }
+    return bmp;
+}
+
+void zBitmapDestroy(zBitmap * bmp)
+{
+#ifdef _WIN32
+    VirtualFree(bmp->pixels, 0, MEM_RELEASE);
+#else
+    free(bmp->pixels);
+#endif
+    free(bmp);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Bitmap pool
+//
+// Capturing at a few Hz would otherwise VirtualAlloc (and page-fault and zero) a full frame every
+// time. Released bitmaps go on a free list and the next request for the same size reuses one, so a
+// steady-state capture/analysis loop makes no OS allocations at all. Reused pixels aren't cleared.
+// The pool is safe to share between threads.
+
+zBitmapPool * zBitmapPoolCreate(int maxFree)
+{
+    zBitmapPool *pool = calloc(1, sizeof(zBitmapPool));
+    zMutexInit(&pool->lock);
+    pool->maxFree = (maxFree > 0) ? maxFree : 1;
+    pool->free = (zBitmap **)calloc(pool->maxFree, sizeof(zBitmap *));
+    return pool;
+}
+
+// bitmaps still handed out when the pool is destroyed must be freed with zBitmapDestroy
+void zBitmapPoolDestroy(zBitmapPool *pool)
+{
+    int i;
+    for(i = 0; i < pool->freeCount; ++i)
+    {
+        zBitmapDestroy(pool->free[i]);
+    }
+    zMutexDestroy(&pool->lock);
+    free(pool->free);
+    free(pool);
+}
+
+zBitmap * zBitmapPoolAcquire(zBitmapPool *pool, int w, int h)
+{
+    int i;
+    zBitmap *bmp = NULL;
+    zMutexLock(&pool->lock);
+    for(i = pool->freeCount - 1; i >= 0; --i)
+    {
+        if((pool->free[i]->w == w) && (pool->free[i]->h == h))
+        {
+            // shifted out, not swapped, so the list stays oldest first for eviction
+            bmp = pool->free[i];
+            memmove(&pool->free[i], &pool->free[i + 1], (pool->freeCount - i - 1) * sizeof(zBitmap *));
+            --pool->freeCount;
+            break;
+        }
+    }
+    if(bmp)
+    {
+        ++pool->hits;
+    }
+    else
+    {
+        ++pool->misses;
+        pool->bytesResident += (size_t)w * h * sizeof(Pixel);
+    }
+    ++pool->outstanding;
+    zMutexUnlock(&pool->lock);
+
+    if(!bmp)
+    {
+        bmp = zBitmapCreate(w, h);
+        if(!bmp)
+        {
+            zMutexLock(&pool->lock);
+            pool->bytesResident -= (size_t)w * h * sizeof(Pixel);
+            --pool->outstanding;
+            zMutexUnlock(&pool->lock);
+        }
+    }
+    return bmp;
+}
+
+// When the free list is full the oldest idle bitmap (likely a stale size) is the one let go
+void zBitmapPoolRelease(zBitmapPool *pool, zBitmap *bmp)
+{
+    zBitmap *evicted = NULL;
+    zMutexLock(&pool->lock);
+    if(pool->freeCount == pool->maxFree)
+    {
+        evicted = pool->free[0];
+        memmove(&pool->free[0], &pool->free[1], (pool->freeCount - 1) * sizeof(zBitmap *));
+        --pool->freeCount;
+        pool->bytesResident -= (size_t)evicted->w * evicted->h * sizeof(Pixel);
+    }
+    pool->free[pool->freeCount++] = bmp;
+    --pool->outstanding;
+    zMutexUnlock(&pool->lock);
+
+    if(evicted)
+    {
+        zBitmapDestroy(evicted);
+    }
+}
+
+void zBitmapPoolPrintStats(zBitmapPool *pool)
+{
+    zMutexLock(&pool->lock);
+    printf("bitmap pool: %d hits, %d misses, %d out, %d idle, %.1f MB resident\n",
+        pool->hits, pool->misses, pool->outstanding, pool->freeCount, pool->bytesResident / (1024.0 * 1024.0));
+    zMutexUnlock(&pool->lock);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Views
+//
+// A zBitmapView is a window onto bitmap pixels: rows are stride pixels apart, so cropping (to the
+// scoreboard, to one champion row, ...) is just pointer math and never copies. Every bitmap
+// operation below works on views; the zBitmap versions are wrappers over a whole-bitmap view.
+// Rects passed alongside a view are in that view's coordinates and aren't clipped.
+
+// rect NULL means the whole view
+void zViewCrop(zBitmapView *view, RECT *rect, zBitmapView *cropped)
+{
+    Pixel *pixels = view->pixels;
+    int w = view->w;
+    int h = view->h;
+    if(rect)
+    {
+        pixels = zViewRow(view, rect->top) + rect->left;
+        w = rect->right - rect->left;
+        h = rect->bottom - rect->top;
+    }
+    cropped->pixels = pixels;
+    cropped->w = w;
+    cropped->h = h;
+    cropped->stride = view->stride;
+}
+
+void zBitmapGetView(zBitmap *zbmp, RECT *rect, zBitmapView *view)
+{
+    zBitmapView whole;
+    whole.pixels = zbmp->pixels;
+    whole.w = zbmp->w;
+    whole.h = zbmp->h;
+    whole.stride = zbmp->w;
+    zViewCrop(&whole, rect, view);
+}
+
+static void viewSubRect(zBitmapView *view, RECT *subRect, RECT *sub)
+{
+    if(subRect)
+    {
+        memcpy(sub, subRect, sizeof(RECT));
+    }
+    else
+    {
+        sub->left = 0;
+        sub->top = 0;
+        sub->right = view->w;
+        sub->bottom = view->h;
+    }
+}
+
+void zViewBox(zBitmapView *view, RECT *rect, int r, int g, int b)
+{
+    int i, j;
+    zBitmapView box;
+    zViewCrop(view, rect, &box);
+    if((box.w > 0) && (box.h > 0))
+    {
+        Pixel *top = zViewRow(&box, 0);
+        Pixel *bottom = zViewRow(&box, box.h - 1);
+        for (j = 0; j < box.h; ++j)
+        {
+            Pixel *row = zViewRow(&box, j);
+            pixelSet(&row[0], r, g, b, row[0].a);
+            pixelSet(&row[box.w - 1], r, g, b, row[box.w - 1].a);
+        }
+        for (i = 0; i < box.w; ++i)
+        {
+            pixelSet(&top[i], r, g, b, top[i].a);
+            pixelSet(&bottom[i], r, g, b, bottom[i].a);
+        }
+    }
+}
+
+void zViewFill(zBitmapView *view, RECT *rect, int r, int g, int b)
+{
+    int i, j;
+    zBitmapView fill;
+    zViewCrop(view, rect, &fill);
+    if((fill.w > 0) && (fill.h > 0))
+    {
+        for (j = 0; j < fill.h; ++j)
+        {
+            Pixel *row = zViewRow(&fill, j);
+            for (i = 0; i < fill.w; ++i)
+            {
+                row[i].r = r;
+                row[i].g = g;
+                row[i].b = b;
+            }
+        }
+    }
+}
+
+void zViewGrayscale(zBitmapView *view, RECT *rect)
+{
+    int i, j;
+    zBitmapView gray;
+    zViewCrop(view, rect, &gray);
+    if((gray.w > 0) && (gray.h > 0))
+    {
+        for (j = 0; j < gray.h; ++j)
+        {
+            Pixel *row = zViewRow(&gray, j);
+            for (i = 0; i < gray.w; ++i)
+            {
+                int sum = (int)row[i].r + (int)row[i].g + (int)row[i].b;
+                int avg = sum / 3;
+                row[i].r = avg;
+                row[i].g = avg;
+                row[i].b = avg;
+            }
+        }
+    }
+}
+
+void zBitmapBox(zBitmap * zbmp, RECT *rect, int r, int g, int b)
+{
+    zBitmapView view;
+    zBitmapGetView(zbmp, NULL, &view);
+    zViewBox(&view, rect, r, g, b);
+}
+
+void zBitmapFill(zBitmap * zbmp, RECT *rect, int r, int g, int b)
+{
+    zBitmapView view;
+    zBitmapGetView(zbmp, NULL, &view);
+    zViewFill(&view, rect, r, g, b);
+}
+
+void zBitmapGrayscale(zBitmap * zbmp, RECT *rect)
+{
+    zBitmapView view;
+    zBitmapGetView(zbmp, NULL, &view);
+    zViewGrayscale(&view, rect);
+}
+
+// returns a whole-row kernel for predicates that have one, NULL otherwise
+static zFindBoxRowKernel findBoxRowKernel(zFindBoxPixelMatchFunc func);
+
+// Picks the box edges out of per-column/per-row match counts (both indexed in bitmap coordinates)
+static void findBoxFromCounts(RECT *subRect, int *colCounts, int *rowCounts, float lineToleranceX, float lineToleranceY, RECT *outputRect)
+{
+    int i, j;
+    int bestRowCount = 0;
+    int bestColCount = 0;
+    RECT sub;
+    memcpy(&sub, subRect, sizeof(RECT));
+
+    for (i = sub.left; i < sub.right; ++i)
+    {
+        if(bestColCount < colCounts[i])
+        {
+            bestColCount = colCounts[i];
+        }
+    }
+    for (j = sub.top; j < sub.bottom; ++j)
+    {
+        if(bestRowCount < rowCounts[j])
+        {
+            bestRowCount = rowCounts[j];
+        }
+    }
+
+    outputRect->left = sub.right;
+    outputRect->right = sub.left;
+    for (i = sub.left; i < sub.right; ++i)
+    {
+        if((outputRect->left > i)
+        && (closeEnough(colCounts[i], bestColCount, bestColCount - (bestColCount * lineToleranceX))))
+        {
+            outputRect->left = i;
+            break;
+        }
+    }
+    for (i = sub.right - 1; i >= sub.left; --i)
+    {
+        if((outputRect->right < i)
+        && (closeEnough(colCounts[i], bestColCount, bestColCount - (bestColCount * lineToleranceX))))
+        {
+            outputRect->right = i;
+            break;
+        }
+    }
+
+    outputRect->top = sub.bottom;
+    outputRect->bottom = sub.top;
+    for (j = sub.top; j < sub.bottom; ++j)
+    {
+        if((outputRect->top > j)
+        && (closeEnough(rowCounts[j], bestRowCount, bestRowCount - (bestRowCount * lineToleranceY))))
+        {
+            outputRect->top = j;
+        }
+    }
+    for (j = sub.bottom - 1; j >= sub.top; --j)
+    {
+        if((outputRect->bottom < j)
+        && (closeEnough(rowCounts[j], bestRowCount, bestRowCount - (bestRowCount * lineToleranceY))))
+        {
+            outputRect->bottom = j;
+        }
+    }
+}
+
+// alpha channel is the tolerance for that color
+int zViewFindBox(zBitmapView *view, RECT *subRect, zFindBoxPixelMatchFunc func, void *userdata, float lineToleranceX, float lineToleranceY, RECT *outputRect, int debug)
+{
+    int i, j;
+    int *colCounts;
+    int *rowCounts;
+    zFindBoxRowKernel kernel = findBoxRowKernel(func);
+
+    RECT sub;
+    zTraceBegin("zViewFindBox");
+    viewSubRect(view, subRect, &sub);
+
+    colCounts = (int *)calloc(sizeof(int), view->w);
+    rowCounts = (int *)calloc(sizeof(int), view->h);
+
+    zTraceBegin("classify");
+    for (j = sub.top; j < sub.bottom; ++j)
+    {
+        Pixel *row = zViewRow(view, j);
+        if(kernel)
+        {
+            rowCounts[j] += kernel(&row[sub.left], sub.right - sub.left, userdata, &colCounts[sub.left]);
+            continue;
+        }
+        for (i = sub.left; i < sub.right; ++i)
+        {
+            if(func(&row[i], userdata))
+            {
+                ++colCounts[i];
+                ++rowCounts[j];
+            }
+        }
+    }
+    zTraceEnd();
+
+    findBoxFromCounts(&sub, colCounts, rowCounts, lineToleranceX, lineToleranceY, outputRect);
+
+    if(debug)
+    {
+        for (i = sub.left; i < sub.right; ++i)
+        {
+            int k;
+            for(k = 0; k < colCounts[i]; ++k)
+            {
+                Pixel *pixel = &zViewRow(view, sub.top + k)[i];
+                pixel->r = 255;
+                pixel->g = 192;
+                pixel->b = 255;
+            }
+        }
+        for (j = sub.top; j < sub.bottom; ++j)
+        {
+            Pixel *row = zViewRow(view, j);
+            int k;
+            for(k = 0; k < rowCounts[j]; ++k)
+            {
+                row[sub.left + k].r = 192;
+                row[sub.left + k].g = 255;
+                row[sub.left + k].b = 192;
+            }
+        }
+    }
+
+    free(colCounts);
+    free(rowCounts);
+    zTraceEnd();
+    return 1;
+}
+
+int zBitmapFindBox(zBitmap *zbmp, RECT *subRect, zFindBoxPixelMatchFunc func, void *userdata, float lineToleranceX, float lineToleranceY, RECT *outputRect, int debug)
+{
+    zBitmapView view;
+    zBitmapGetView(zbmp, NULL, &view);
+    return zViewFindBox(&view, subRect, func, userdata, lineToleranceX, lineToleranceY, outputRect, debug);
+}
+
+typedef struct FindBoxSlice
+{
+    zBitmapView *view;
+    RECT *sub;
+    zFindBoxPixelMatchFunc func;
+    zFindBoxRowKernel kernel;
+    void *userdata;
+    int slices;
+    int *colCounts; // slices * sub width, one private histogram per slice
+    int *rowCounts;
+} FindBoxSlice;
+
+static void findBoxSliceWork(void *context, int index)
+{
+    FindBoxSlice *job = (FindBoxSlice *)context;
+    RECT *sub = job->sub;
+    int width = sub->right - sub->left;
+    int rows = sub->bottom - sub->top;
+    int top = sub->top + (int)(((long long)rows * index) / job->slices);
+    int bottom = sub->top + (int)(((long long)rows * (index + 1)) / job->slices);
+    int *colCounts = &job->colCounts[index * width];
+    int i, j;
+
+    zTraceBegin("classify slice");
+    for (j = top; j < bottom; ++j)
+    {
+        Pixel *row = zViewRow(job->view, j) + sub->left;
+        if(job->kernel)
+        {
+            job->rowCounts[j] = job->kernel(row, width, job->userdata, colCounts);
+            continue;
+        }
+        for (i = 0; i < width; ++i)
+        {
+            if(job->func(&row[i], job->userdata))
+            {
+                ++colCounts[i];
+                ++job->rowCounts[j];
+            }
+        }
+    }
+    zTraceEnd();
+}
+
+// zViewFindBox split across a worker pool by rows. Each slice keeps its own column histogram and
+// they're summed afterwards, so the counts (and outputRect) are exactly those of the serial search.
+// The predicate must be safe to call from several threads at once.
+int zViewFindBoxParallel(zWorkerPool *pool, zBitmapView *view, RECT *subRect, zFindBoxPixelMatchFunc func, void *userdata, float lineToleranceX, float lineToleranceY, RECT *outputRect)
+{
+    int i, k;
+    int width;
+    int *colCounts;
+    FindBoxSlice job;
+    RECT sub;
+    zTraceBegin("zViewFindBoxParallel");
+    viewSubRect(view, subRect, &sub);
+    width = (sub.right > sub.left) ? sub.right - sub.left : 0;
+
+    job.view = view;
+    job.sub = &sub;
+    job.func = func;
+    job.kernel = findBoxRowKernel(func);
+    job.userdata = userdata;
+    job.slices = pool->threadCount;
+    if(job.slices > (sub.bottom - sub.top))
+    {
+        job.slices = (sub.bottom > sub.top) ? sub.bottom - sub.top : 1;
+    }
+    job.colCounts = (int *)calloc(sizeof(int), (width * job.slices) + 1);
+    job.rowCounts = (int *)calloc(sizeof(int), view->h);
+    colCounts = (int *)calloc(sizeof(int), view->w);
+
+    zWorkerPoolRun(pool, findBoxSliceWork, &job, job.slices);
+
+    for (k = 0; k < job.slices; ++k)
+    {
+        int *slice = &job.colCounts[k * width];
+        for (i = 0; i < width; ++i)
+        {
+            colCounts[sub.left + i] += slice[i];
+        }
+    }
+
+    findBoxFromCounts(&sub, colCounts, job.rowCounts, lineToleranceX, lineToleranceY, outputRect);
+
+    free(job.colCounts);
+    free(job.rowCounts);
+    free(colCounts);
+    zTraceEnd();
+    return 1;
+}
+
+int zBitmapFindBoxParallel(zWorkerPool *pool, zBitmap *zbmp, RECT *subRect, zFindBoxPixelMatchFunc func, void *userdata, float lineToleranceX, float lineToleranceY, RECT *outputRect)
+{
+    zBitmapView view;
+    zBitmapGetView(zbmp, NULL, &view);
+    return zViewFindBoxParallel(pool, &view, subRect, func, userdata, lineToleranceX, lineToleranceY, outputRect);
+}
+
+// Runs several FindBox searches in one walk over the union of their sub-rects: each row is
+// fetched once and every query covering it classifies its span while the row is still in cache.
+// Each query's outputRect is exactly what zViewFindBox would return for it on its own.
+int zViewFindBoxes(zBitmapView *view, zFindBoxQuery *queries, int count)
+{
+    int i, j, q;
+    RECT *subs;
+    zFindBoxRowKernel *kernels;
+    int **colCounts;
+    int **rowCounts;
+    int *scratch;
+    int top = view->h;
+    int bottom = 0;
+
+    if(count <= 0)
+    {
+        return 1;
+    }
+    zTraceBegin("zViewFindBoxes");
+    subs = (RECT *)calloc(count, sizeof(RECT));
+    kernels = (zFindBoxRowKernel *)calloc(count, sizeof(zFindBoxRowKernel));
+    colCounts = (int **)calloc(count, sizeof(int *));
+    rowCounts = (int **)calloc(count, sizeof(int *));
+    scratch = (int *)calloc(sizeof(int), (view->w + view->h) * count);
+
+    for (q = 0; q < count; ++q)
+    {
+        viewSubRect(view, queries[q].subRect, &subs[q]);
+        kernels[q] = findBoxRowKernel(queries[q].func);
+        colCounts[q] = queries[q].colCounts ? queries[q].colCounts : &scratch[q * (view->w + view->h)];
+        rowCounts[q] = queries[q].rowCounts ? queries[q].rowCounts : &scratch[(q * (view->w + view->h)) + view->w];
+        memset(colCounts[q], 0, sizeof(int) * view->w);
+        memset(rowCounts[q], 0, sizeof(int) * view->h);
+        if(subs[q].top < top)
+        {
+            top = subs[q].top;
+        }
+        if(subs[q].bottom > bottom)
+        {
+            bottom = subs[q].bottom;
+        }
+    }
+
+    zTraceBegin("classify");
+    for (j = top; j < bottom; ++j)
+    {
+        Pixel *row = zViewRow(view, j);
+        for (q = 0; q < count; ++q)
+        {
+            RECT *sub = &subs[q];
+            if((j < sub->top) || (j >= sub->bottom))
+            {
+                continue;
+            }
+            if(kernels[q])
+            {
+                rowCounts[q][j] += kernels[q](&row[sub->left], sub->right - sub->left, queries[q].userdata, &colCounts[q][sub->left]);
+                continue;
+            }
+            for (i = sub->left; i < sub->right; ++i)
+            {
+                if(queries[q].func(&row[i], queries[q].userdata))
+                {
+                    ++colCounts[q][i];
+                    ++rowCounts[q][j];
+                }
+            }
+        }
+    }
+
+    zTraceEnd();
+
+    for (q = 0; q < count; ++q)
+    {
+        findBoxFromCounts(&subs[q], colCounts[q], rowCounts[q], queries[q].lineToleranceX, queries[q].lineToleranceY, &queries[q].outputRect);
+    }
+
+    free(subs);
+    free(kernels);
+    free(colCounts);
+    free(rowCounts);
+    free(scratch);
+    zTraceEnd();
+    return 1;
+}
+
+int zBitmapFindBoxes(zBitmap *zbmp, zFindBoxQuery *queries, int count)
+{
+    zBitmapView view;
+    zBitmapGetView(zbmp, NULL, &view);
+    return zViewFindBoxes(&view, queries, count);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// An open PNG set up to hand out rows in zBitmap's layout
+typedef struct PngReader
+{
+    FILE *fp;
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_infop end_info;
+    int w;
+    int h;
+    int passes;
+} PngReader;
+
+static int pngReaderOpen(PngReader *reader, const char * file_name)
+{
+    png_byte header[8];
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_infop end_info;
+    int bit_depth, color_type;
+    png_uint_32 temp_width, temp_height;
+
+    FILE * fp = fopen(file_name, "rb");
+    if (fp == 0)
+    {
+        perror(file_name);
+        return 0;
+    }
+
+    // read the header
+    fread(header, 1, 8, fp);
+
+    if (png_sig_cmp(header, 0, 8))
+    {
+        fprintf(stderr, "error: %s is not a PNG.\n", file_name);
+        fclose(fp);
+        return 0;
+    }
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png_ptr)
+    {
+        fprintf(stderr, "error: png_create_read_struct returned 0.\n");
+        fclose(fp);
+        return 0;
+    }
+
+    info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+    {
+        fprintf(stderr, "error: png_create_info_struct returned 0.\n");
+        png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
+        fclose(fp);
+        return 0;
+    }
+
+    end_info = png_create_info_struct(png_ptr);
+    if (!end_info)
+    {
+        fprintf(stderr, "error: png_create_info_struct returned 0.\n");
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
+        fclose(fp);
+        return 0;
+    }
+
+    // libpng reports errors by longjmp (after printing them), and aborts if nothing catches them
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        fclose(fp);
+        return 0;
+    }
+
+    png_init_io(png_ptr, fp);
+    png_set_sig_bytes(png_ptr, 8);
+    png_read_info(png_ptr, info_ptr);
+
+    // get info about png
+    png_get_IHDR(png_ptr, info_ptr, &temp_width, &temp_height, &bit_depth, &color_type,
+                 NULL, NULL, NULL);
+
+    // w * h pixels have to fit the int arithmetic used on zBitmaps
+    if ((temp_width == 0) || (temp_height == 0) || (temp_width > INT_MAX / sizeof(Pixel))
+    || (temp_height > INT_MAX / sizeof(Pixel) / temp_width))
+    {
+        fprintf(stderr, "%s: %ux%u is too large.\n", file_name, (unsigned int)temp_width, (unsigned int)temp_height);
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        fclose(fp);
+        return 0;
+    }
+
+    if (bit_depth != 8)
+    {
+        fprintf(stderr, "%s: Unsupported bit depth %d.  Must be 8.\n", file_name, bit_depth);
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        fclose(fp);
+        return 0;
+    }
+
+    // Have libpng produce zBitmap's layout directly: BGR order plus a zero filler byte
+    // (matching the zeroed alpha of a fresh zBitmap), any source alpha dropped.
+    if (color_type == PNG_COLOR_TYPE_PALETTE)
+    {
+        png_set_palette_to_rgb(png_ptr);
+    }
+    if ((color_type == PNG_COLOR_TYPE_GRAY) || (color_type == PNG_COLOR_TYPE_GRAY_ALPHA))
+    {
+        png_set_gray_to_rgb(png_ptr);
+    }
+    png_set_strip_alpha(png_ptr);
+    png_set_bgr(png_ptr);
+    png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
+    reader->passes = png_set_interlace_handling(png_ptr);
+
+    // Update the png info struct.
+    png_read_update_info(png_ptr, info_ptr);
+
+    if (png_get_rowbytes(png_ptr, info_ptr) != (temp_width * sizeof(Pixel)))
+    {
+        fprintf(stderr, "%s: Unsupported PNG layout (color type %d).\n", file_name, color_type);
+        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+        fclose(fp);
+        return 0;
+    }
+
+    reader->fp = fp;
+    reader->png_ptr = png_ptr;
+    reader->info_ptr = info_ptr;
+    reader->end_info = end_info;
+    reader->w = (int)temp_width;
+    reader->h = (int)temp_height;
+    return 1;
+}
+
+static void pngReaderClose(PngReader *reader)
+{
+    png_destroy_read_struct(&reader->png_ptr, &reader->info_ptr, &reader->end_info);
+    fclose(reader->fp);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Fast path for 8-bit RGB PNGs
+//
+// Screenshots are nearly always plain 8-bit RGB without interlacing, and for those libpng's
+// generality costs more than the work itself: it inflates each row separately, unfilters it into
+// its own buffer, then runs the filler and BGR transforms as extra passes. Here the IDAT payloads
+// are packed together so one inflate stream covers them, and each inflated row is unfiltered and
+// widened to BGRA in the same loop, straight into the bitmap. Anything else (other color types or
+// depths, interlacing, a bad CRC, truncated data) is left to libpng, so errors still read the same.
+
+static int sPngFastPath = 1;
+
+void zSetPngFastPath(int enabled)
+{
+    sPngFastPath = enabled;
+}
+
+static __inline unsigned int pngRead32(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+// Written as two selects rather than the spec's branches; screenshots are mostly Paeth rows and
+// the branches mispredict on noisy pixels.
+static __inline int pngPaeth(int a, int b, int c)
+{
+    int p = b - c;
+    int q = a - c;
+    int pa = (p < 0) ? -p : p;
+    int pb = (q < 0) ? -q : q;
+    int pc = (p + q < 0) ? -(p + q) : (p + q);
+    if(pb < pa)
+    {
+        pa = pb;
+        a = b;
+    }
+    return (pc < pa) ? c : a;
+}
+
+static __inline void pngStoreRgb(unsigned char *cur, Pixel *dst, int r, int g, int b)
+{
+    cur[0] = (unsigned char)r;
+    cur[1] = (unsigned char)g;
+    cur[2] = (unsigned char)b;
+    dst->b = (unsigned char)b;
+    dst->g = (unsigned char)g;
+    dst->r = (unsigned char)r;
+    dst->a = 0;
+}
+
+// Reconstructs cur (filter byte already stripped) in place against prev (zeros above the first
+// row) and writes each finished pixel to dst. Each channel's left and upper-left neighbours stay
+// in locals, so the only serial dependency is through registers rather than the row buffer.
+// Returns 0 for an unknown filter type.
+static int pngUnfilterRgbRow(int filter, unsigned char *cur, const unsigned char *prev, int w, Pixel *dst)
+{
+    int r = 0, g = 0, b = 0;
+    int ur = 0, ug = 0, ub = 0;
+    int i;
+    switch(filter)
+    {
+        case 0: // None
+            for(i = 0; i < w; ++i, cur += 3)
+            {
+                pngStoreRgb(cur, &dst[i], cur[0], cur[1], cur[2]);
+            }
+            break;
+        case 1: // Sub
+            for(i = 0; i < w; ++i, cur += 3)
+            {
+                r = (cur[0] + r) & 0xff;
+                g = (cur[1] + g) & 0xff;
+                b = (cur[2] + b) & 0xff;
+                pngStoreRgb(cur, &dst[i], r, g, b);
+            }
+            break;
+        case 2: // Up
+            for(i = 0; i < w; ++i, cur += 3, prev += 3)
+            {
+                pngStoreRgb(cur, &dst[i], (cur[0] + prev[0]) & 0xff, (cur[1] + prev[1]) & 0xff, (cur[2] + prev[2]) & 0xff);
+            }
+            break;
+        case 3: // Average
+            for(i = 0; i < w; ++i, cur += 3, prev += 3)
+            {
+                r = (cur[0] + ((r + prev[0]) >> 1)) & 0xff;
+                g = (cur[1] + ((g + prev[1]) >> 1)) & 0xff;
+                b = (cur[2] + ((b + prev[2]) >> 1)) & 0xff;
+                pngStoreRgb(cur, &dst[i], r, g, b);
+            }
+            break;
+        case 4: // Paeth
+            for(i = 0; i < w; ++i, cur += 3, prev += 3)
+            {
+                r = (cur[0] + pngPaeth(r, prev[0], ur)) & 0xff;
+                g = (cur[1] + pngPaeth(g, prev[1], ug)) & 0xff;
+                b = (cur[2] + pngPaeth(b, prev[2], ub)) & 0xff;
+                ur = prev[0];
+                ug = prev[1];
+                ub = prev[2];
+                pngStoreRgb(cur, &dst[i], r, g, b);
+            }
+            break;
+        default:
+            return 0;
+    }
+    return 1;
+}
+
+static unsigned char * readWholeFile(const char *file_name, size_t *size)
+{
+    unsigned char *data;
+    long length;
+    FILE *fp = fopen(file_name, "rb");
+    if(!fp)
+    {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if(length <= 0)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    data = (unsigned char *)malloc(length);
+    if(fread(data, 1, length, fp) != (size_t)length)
+    {
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    *size = (size_t)length;
+    return data;
+}
+
+// A file the fast path can take: its IDAT payloads packed together at the start of data
+typedef struct RgbPng
+{
+    unsigned char *data;
+    size_t idatSize;
+    int w;
+    int h;
+    int rowBytes;   // filter byte plus w RGB triples
+    int stripRows;  // from a valid stRP chunk (see Striped PNGs), otherwise 0
+    int stripCount;
+    unsigned int *stripOffsets;
+} RgbPng;
+
+static void rgbPngReadStrips(RgbPng *png, const unsigned char *index, unsigned int length);
+
+// Returns 0 whenever libpng should handle the file instead
+static int rgbPngOpen(RgbPng *png, const char *file_name)
+{
+    static const unsigned char signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+    unsigned char *data;
+    size_t size;
+    size_t offset;
+    size_t idatSize = 0;
+    unsigned int w, h;
+    int ok = 0;
+
+    memset(png, 0, sizeof(RgbPng));
+    data = readWholeFile(file_name, &size);
+    if(!data)
+    {
+        return 0;
+    }
+    if((size < 33) || memcmp(data, signature, 8) || (pngRead32(data + 8) != 13) || memcmp(data + 12, "IHDR", 4)
+    || (crc32(crc32(0L, Z_NULL, 0), data + 12, 17) != pngRead32(data + 29)))
+    {
+        free(data);
+        return 0;
+    }
+    w = pngRead32(data + 16);
+    h = pngRead32(data + 20);
+    // 8-bit truecolor, deflate, adaptive filtering, not interlaced
+    if((data[24] != 8) || (data[25] != 2) || data[26] || data[27] || data[28]
+    || (w == 0) || (h == 0) || (w > INT_MAX / sizeof(Pixel)) || (h > INT_MAX / sizeof(Pixel) / w))
+    {
+        free(data);
+        return 0;
+    }
+
+    png->w = (int)w;
+    png->h = (int)h;
+    png->rowBytes = 1 + (int)w * 3;
+
+    // Pack every IDAT payload down to the start of the buffer (each only ever moves backwards)
+    offset = 33;
+    while(offset + 12 <= size)
+    {
+        unsigned int length = pngRead32(data + offset);
+        const unsigned char *type = data + offset + 4;
+        if((length > size - offset - 12) || (crc32(crc32(0L, Z_NULL, 0), type, length + 4) != pngRead32(type + 4 + length)))
+        {
+            break;
+        }
+        if(!memcmp(type, "IDAT", 4))
+        {
+            memmove(data + idatSize, type + 4, length);
+            idatSize += length;
+        }
+        else if(!memcmp(type, "IEND", 4))
+        {
+            ok = 1;
+            break;
+        }
+        else if(!memcmp(type, "stRP", 4) && (idatSize == 0))
+        {
+            rgbPngReadStrips(png, type + 4, length);
+        }
+        else if(!(type[0] & 0x20))
+        {
+            break; // an unknown critical chunk (PLTE is allowed in truecolor, but unused)
+        }
+        offset += length + 12;
+    }
+    if(!ok || (idatSize == 0))
+    {
+        free(png->stripOffsets);
+        free(data);
+        return 0;
+    }
+
+    png->data = data;
+    png->idatSize = idatSize;
+    if(png->stripCount && (png->stripOffsets[png->stripCount - 1] >= idatSize))
+    {
+        png->stripCount = 0;
+    }
+    return 1;
+}
+
+static void rgbPngClose(RgbPng *png)
+{
+    free(png->stripOffsets);
+    free(png->data);
+}
+
+// Where finished rows go: into zbmp's rows when there is one (otherwise through scratch), then to
+// stream if there is one, which may end the decode early.
+typedef struct RgbPngSink
+{
+    zBitmap *zbmp;
+    zStreamAnalyzer *stream;
+    Pixel *scratch;
+    int rowsDecoded;
+    int stopped;
+} RgbPngSink;
+
+// Unfilters and converts raw row j (prev is row j - 1 already reconstructed, or zeros) and hands it
+// on. Returns 0 for a bad filter type.
+static int rgbPngFinishRow(RgbPng *png, RgbPngSink *sink, int j, unsigned char *cur, const unsigned char *prev)
+{
+    Pixel *dst = sink->zbmp ? &sink->zbmp->pixels[j * png->w] : sink->scratch;
+    if(!pngUnfilterRgbRow(cur[0], cur + 1, prev + 1, png->w, dst))
+    {
+        return 0;
+    }
+    ++sink->rowsDecoded;
+    if(sink->stream && !zStreamAnalyzerPushRow(sink->stream, dst))
+    {
+        sink->stopped = 1;
+    }
+    return 1;
+}
+
+static int rgbPngInflateRow(z_stream *inflater, unsigned char *row, int rowBytes)
+{
+    int status;
+    inflater->next_out = row;
+    inflater->avail_out = rowBytes;
+    status = inflate(inflater, Z_SYNC_FLUSH);
+    return (inflater->avail_out == 0) && ((status == Z_OK) || (status == Z_STREAM_END));
+}
+
+static int rgbPngDecodeSerial(RgbPng *png, z_stream *inflater, RgbPngSink *sink)
+{
+    unsigned char *rows[2];
+    int ok = 1;
+    int j;
+
+    rows[0] = (unsigned char *)calloc(2, png->rowBytes);
+    rows[1] = rows[0] + png->rowBytes;
+    for(j = 0; ok && !sink->stopped && (j < png->h); ++j)
+    {
+        unsigned char *cur = rows[j & 1];
+        ok = rgbPngInflateRow(inflater, cur, png->rowBytes)
+          && rgbPngFinishRow(png, sink, j, cur, rows[(j & 1) ^ 1]);
+    }
+    free(rows[0]);
+    return ok;
+}
+
+// Pipelined decode
+//
+// Inflate is serial and is most of the work, but nothing after it needs to wait for the whole
+// stream: a second thread inflates raw rows into a ring while the caller unfilters, converts and
+// analyzes the ones already there. Row j's slot stays in use until row j + 1 has been unfiltered
+// against it, so the inflater runs at most RGB_RING_ROWS - 1 rows ahead.
+//
+// The inflating is done by helper threads that are started on first use and then stay parked
+// between images, until zPngShutdown joins them. There are at most one fewer than the CPUs (but at
+// least one); a decode that finds them all busy runs serially instead of adding threads.
+
+#define RGB_RING_ROWS 64
+
+typedef struct RgbRing
+{
+    RgbPng *png;
+    z_stream *inflater;
+    unsigned char *rows;        // RGB_RING_ROWS raw rows
+    zMutex lock;
+    zCond changed;
+    int inflated;               // rows [0, inflated) are ready
+    int released;               // rows [0, released) may be overwritten
+    int failed;                 // inflate error; no more rows are coming
+    int stop;                   // the consumer is done early
+    int finished;               // the helper is done with the ring
+    int waiting;                // someone is blocked on changed
+} RgbRing;
+
+typedef struct RgbHelper
+{
+    struct RgbHelper *next;     // every helper started, never removed
+    volatile long busy;         // claimed by a decode
+    zThread thread;
+    zMutex lock;
+    zCond wake;
+    RgbRing *ring;              // the current job, NULL while parked
+    int quit;                   // zPngShutdown: exit once parked
+} RgbHelper;
+
+static RgbHelper * volatile sRgbHelpers = NULL;
+static volatile long sRgbHelperCount = 0;
+
+static unsigned char * rgbRingRow(RgbRing *ring, int j)
+{
+    return ring->rows + (size_t)(j % RGB_RING_ROWS) * ring->png->rowBytes;
+}
+
+static void rgbRingInflate(RgbRing *ring)
+{
+    int j;
+
+    zTraceBegin("inflate");
+    for(j = 0; j < ring->png->h; ++j)
+    {
+        int ok;
+        zMutexLock(&ring->lock);
+        while(!ring->stop && (j - ring->released >= RGB_RING_ROWS))
+        {
+            ++ring->waiting;
+            zCondWait(&ring->changed, &ring->lock);
+            --ring->waiting;
+        }
+        if(ring->stop)
+        {
+            zMutexUnlock(&ring->lock);
+            break;
+        }
+        zMutexUnlock(&ring->lock);
+
+        ok = rgbPngInflateRow(ring->inflater, rgbRingRow(ring, j), ring->png->rowBytes);
+
+        zMutexLock(&ring->lock);
+        if(ok)
+        {
+            ring->inflated = j + 1;
+        }
+        else
+        {
+            ring->failed = 1;
+        }
+        if(ring->waiting)
+        {
+            zCondBroadcast(&ring->changed);
+        }
+        zMutexUnlock(&ring->lock);
+        if(!ok)
+        {
+            break;
+        }
+    }
+    zTraceEnd();
+}
+
+static void rgbHelperThread(void *arg)
+{
+    RgbHelper *helper = (RgbHelper *)arg;
+    for(;;)
+    {
+        RgbRing *ring;
+        zMutexLock(&helper->lock);
+        while(!helper->ring && !helper->quit)
+        {
+            zCondWait(&helper->wake, &helper->lock);
+        }
+        ring = helper->ring;
+        zMutexUnlock(&helper->lock);
+        if(!ring)
+        {
+            return;
+        }
+
+        rgbRingInflate(ring);
+
+        zMutexLock(&helper->lock);
+        helper->ring = NULL;
+        zMutexUnlock(&helper->lock);
+        // the last touch of the ring: the decode may free it as soon as it sees finished
+        zMutexLock(&ring->lock);
+        ring->finished = 1;
+        zCondBroadcast(&ring->changed);
+        zMutexUnlock(&ring->lock);
+    }
+}
+
+// Returns an idle helper, now busy, starting one if there's room; NULL if there isn't
+static RgbHelper * rgbHelperClaim(void)
+{
+    RgbHelper *helper;
+    long count;
+    long limit = (zCpuCount() > 2) ? (zCpuCount() - 1) : 1;
+
+    for(helper = (RgbHelper *)zAtomicLoadPointer(&sRgbHelpers); helper; helper = helper->next)
+    {
+        if(zAtomicCas(&helper->busy, 0, 1))
+        {
+            return helper;
+        }
+    }
+    do
+    {
+        count = zAtomicLoad(&sRgbHelperCount);
+        if(count >= limit)
+        {
+            return NULL;
+        }
+    } while(!zAtomicCas(&sRgbHelperCount, count, count + 1));
+
+    // a helper that fails to start keeps its place in the count, so it isn't retried every image
+    helper = (RgbHelper *)calloc(1, sizeof(RgbHelper));
+    helper->busy = 1;
+    zMutexInit(&helper->lock);
+    zCondInit(&helper->wake);
+    if(!zThreadCreate(&helper->thread, rgbHelperThread, helper))
+    {
+        zCondDestroy(&helper->wake);
+        zMutexDestroy(&helper->lock);
+        free(helper);
+        return NULL;
+    }
+    do
+    {
+        helper->next = (RgbHelper *)zAtomicLoadPointer(&sRgbHelpers);
+    } while(!zAtomicCasPointer(&sRgbHelpers, helper->next, helper));
+    return helper;
+}
+
+static int rgbPngDecodePipelined(RgbPng *png, z_stream *inflater, RgbPngSink *sink)
+{
+    RgbRing ring;
+    RgbHelper *helper;
+    unsigned char *zeros;
+    int ok = 1;
+    int j;
+
+    helper = rgbHelperClaim();
+    if(!helper)
+    {
+        return rgbPngDecodeSerial(png, inflater, sink);
+    }
+    memset(&ring, 0, sizeof(ring));
+    ring.png = png;
+    ring.inflater = inflater;
+    ring.rows = (unsigned char *)malloc((size_t)RGB_RING_ROWS * png->rowBytes);
+    zeros = (unsigned char *)calloc(1, png->rowBytes);
+    zMutexInit(&ring.lock);
+    zCondInit(&ring.changed);
+    zMutexLock(&helper->lock);
+    helper->ring = &ring;
+    zCondSignal(&helper->wake);
+    zMutexUnlock(&helper->lock);
+
+    for(j = 0; ok && !sink->stopped && (j < png->h); ++j)
+    {
+        zMutexLock(&ring.lock);
+        // free the slot of row j - 2, the last one no longer needed as a previous row
+        ring.released = (j > 1) ? (j - 1) : 0;
+        if(ring.waiting)
+        {
+            zCondBroadcast(&ring.changed);
+        }
+        while((ring.inflated <= j) && !ring.failed)
+        {
+            ++ring.waiting;
+            zCondWait(&ring.changed, &ring.lock);
+            --ring.waiting;
+        }
+        ok = (ring.inflated > j);
+        zMutexUnlock(&ring.lock);
+
+        ok = ok && rgbPngFinishRow(png, sink, j, rgbRingRow(&ring, j), (j > 0) ? rgbRingRow(&ring, j - 1) : zeros);
+    }
+
+    zMutexLock(&ring.lock);
+    ring.stop = 1;
+    zCondBroadcast(&ring.changed);
+    while(!ring.finished)
+    {
+        zCondWait(&ring.changed, &ring.lock);
+    }
+    zMutexUnlock(&ring.lock);
+    zAtomicExchange(&helper->busy, 0);
+
+    zCondDestroy(&ring.changed);
+    zMutexDestroy(&ring.lock);
+    free(zeros);
+    free(ring.rows);
+    return ok;
+}
+
+// Off until it's been shown to pay on multi-core machines; -1 picks it whenever there's more than
+// one CPU (even then batch callers, already running a decode per CPU, should leave it off)
+static int sPngPipeline = 0;
+
+void zSetPngPipeline(int mode)
+{
+    sPngPipeline = mode;
+}
+
+// Returns 0 on a decode error (the sink may have seen some rows by then)
+static int rgbPngDecode(RgbPng *png, RgbPngSink *sink)
+{
+    z_stream inflater;
+    int pipelined = (sPngPipeline < 0) ? (zCpuCount() > 1) : sPngPipeline;
+    int ok;
+
+    memset(&inflater, 0, sizeof(inflater));
+    if(inflateInit(&inflater) != Z_OK)
+    {
+        return 0;
+    }
+    inflater.next_in = png->data;
+    inflater.avail_in = (uInt)png->idatSize;
+    if(!sink->zbmp)
+    {
+        sink->scratch = (Pixel *)malloc(png->w * sizeof(Pixel));
+    }
+
+    ok = pipelined ? rgbPngDecodePipelined(png, &inflater, sink) : rgbPngDecodeSerial(png, &inflater, sink);
+
+    free(sink->scratch);
+    sink->scratch = NULL;
+    inflateEnd(&inflater);
+    return ok;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Striped PNGs
+//
+// A PNG's image data is one deflate stream, so normally nothing can be inflated before everything
+// ahead of it has been. zSaveStripedPng writes an ordinary 8-bit RGB PNG whose stream is fully
+// flushed every stripRows rows (the compressor forgets its history, so each strip's data stands
+// alone) and whose first row in each strip is filtered without looking at the row above. A private
+// stRP chunk ahead of the IDATs records where each strip starts:
+//
+//   stripRows, stripCount, stripCount offsets into the concatenated IDAT data (4 bytes each, MSB first)
+//
+// Decoders that don't know stRP skip it (ancillary, so safe to ignore; unsafe to copy, because
+// it's only correct for these exact IDATs). The fast path uses it to inflate and unfilter strips
+// on all cores, checking the stream's Adler-32 from the per-strip sums; if anything doesn't add up
+// the file is simply decoded serially.
+
+// threads for striped decoding; 0 uses one per CPU
+static int sPngStripThreads = 0;
+
+// One pool serves every striped decode, created on first use and rebuilt only when the thread
+// count changes. Whoever holds sStripPoolBusy owns it; an image that finds it taken (another
+// thread is already decoding strips on every core) just decodes serially.
+static zWorkerPool *sStripPool = NULL;
+static int sStripPoolThreads = 0;
+static volatile long sStripPoolBusy = 0;
+
+void zSetPngStripThreads(int threads)
+{
+    sPngStripThreads = threads;
+}
+
+// Nothing may be decoding: the helpers are all parked and nobody holds the strip pool
+void zPngShutdown(void)
+{
+    RgbHelper *helper = (RgbHelper *)sRgbHelpers;
+    while(helper)
+    {
+        RgbHelper *next = helper->next;
+        zMutexLock(&helper->lock);
+        helper->quit = 1;
+        zCondSignal(&helper->wake);
+        zMutexUnlock(&helper->lock);
+        zThreadJoin(helper->thread);
+        zCondDestroy(&helper->wake);
+        zMutexDestroy(&helper->lock);
+        free(helper);
+        helper = next;
+    }
+    sRgbHelpers = NULL;
+    sRgbHelperCount = 0;
+
+    if(sStripPool)
+    {
+        zWorkerPoolDestroy(sStripPool);
+        sStripPool = NULL;
+        sStripPoolThreads = 0;
+    }
+}
+
+static __inline void pngPut32(unsigned char *p, unsigned int v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// Keeps an index only if it describes whole strips covering the image in stream order
+static void rgbPngReadStrips(RgbPng *png, const unsigned char *index, unsigned int length)
+{
+    unsigned int stripRows, stripCount, k;
+    if(length < 8)
+    {
+        return;
+    }
+    stripRows = pngRead32(index);
+    stripCount = pngRead32(index + 4);
+    // bounded by the chunk and the image before anything is computed from it
+    if((stripRows == 0) || (stripCount == 0) || (stripCount > (length - 8) / 4) || (stripCount > (unsigned int)png->h)
+    || (stripCount != ((unsigned int)png->h - 1) / stripRows + 1) || (length != 8 + 4 * stripCount))
+    {
+        return;
+    }
+    free(png->stripOffsets);
+    png->stripOffsets = (unsigned int *)malloc(stripCount * sizeof(unsigned int));
+    for(k = 0; k < stripCount; ++k)
+    {
+        png->stripOffsets[k] = pngRead32(index + 8 + 4 * k);
+        if((k == 0) ? (png->stripOffsets[0] != 2) : (png->stripOffsets[k] <= png->stripOffsets[k - 1]))
+        {
+            free(png->stripOffsets);
+            png->stripOffsets = NULL;
+            return;
+        }
+    }
+    png->stripRows = (stripRows < (unsigned int)png->h) ? (int)stripRows : png->h;
+    png->stripCount = (int)stripCount;
+}
+
+typedef struct StripDecode
+{
+    RgbPng *png;
+    zBitmap *zbmp;
+    unsigned char *raw;         // every raw row, strips inflated in place
+    unsigned char *zeros;       // the "row above" for rows that don't have one
+    unsigned long *adlers;      // per strip
+    int *status;                // per strip: 0 failed, 1 done, 2 inflated but needs the strip above
+} StripDecode;
+
+static int stripUnfilter(StripDecode *decode, int k)
+{
+    RgbPng *png = decode->png;
+    int first = k * png->stripRows;
+    int last = (first + png->stripRows < png->h) ? (first + png->stripRows) : png->h;
+    int j;
+    for(j = first; j < last; ++j)
+    {
+        unsigned char *cur = decode->raw + (size_t)j * png->rowBytes;
+        const unsigned char *prev = (j > 0) ? (cur - png->rowBytes) : decode->zeros;
+        if(!pngUnfilterRgbRow(cur[0], cur + 1, prev + 1, png->w, &decode->zbmp->pixels[(size_t)j * png->w]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void stripDecodeWork(void *context, int k)
+{
+    StripDecode *decode = (StripDecode *)context;
+    RgbPng *png = decode->png;
+    int first = k * png->stripRows;
+    int rows = (first + png->stripRows < png->h) ? png->stripRows : (png->h - first);
+    size_t end = (k + 1 < png->stripCount) ? png->stripOffsets[k + 1] : png->idatSize;
+    unsigned char *out = decode->raw + (size_t)first * png->rowBytes;
+    uInt length = (uInt)rows * png->rowBytes;
+    z_stream inflater;
+    int status;
+
+    zTraceBegin("strip");
+    decode->status[k] = 0;
+    memset(&inflater, 0, sizeof(inflater));
+    if(inflateInit2(&inflater, -15) == Z_OK)
+    {
+        inflater.next_in = png->data + png->stripOffsets[k];
+        inflater.avail_in = (uInt)(end - png->stripOffsets[k]);
+        inflater.next_out = out;
+        inflater.avail_out = length;
+        status = inflate(&inflater, Z_SYNC_FLUSH);
+        if((inflater.avail_out == 0) && ((status == Z_OK) || (status == Z_STREAM_END)))
+        {
+            decode->adlers[k] = adler32(adler32(0L, Z_NULL, 0), out, length);
+            // a first row filtered against the row above has to wait for that strip
+            if((k > 0) && (out[0] >= 2))
+            {
+                decode->status[k] = 2;
+            }
+            else
+            {
+                decode->status[k] = stripUnfilter(decode, k);
+            }
+        }
+        inflateEnd(&inflater);
+    }
+    zTraceEnd();
+}
+
+// Returns 0 if the file has no usable strip index, or anything about it doesn't check out (zbmp
+// may be partly written by then)
+static int rgbPngDecodeStrips(RgbPng *png, zBitmap *zbmp)
+{
+    StripDecode decode;
+    zWorkerPool *pool;
+    unsigned long adler;
+    int threads = (sPngStripThreads > 0) ? sPngStripThreads : zCpuCount();
+    int ok = 1;
+    int k;
+
+    if((png->stripCount < 2) || (threads < 2) || (png->idatSize < 6))
+    {
+        return 0;
+    }
+    if(!zAtomicCas(&sStripPoolBusy, 0, 1))
+    {
+        return 0;
+    }
+
+    zTraceBegin("rgbPngDecodeStrips");
+    if(sStripPool && (sStripPoolThreads != threads))
+    {
+        zWorkerPoolDestroy(sStripPool);
+        sStripPool = NULL;
+    }
+    if(!sStripPool)
+    {
+        sStripPool = zWorkerPoolCreate(threads);
+        sStripPoolThreads = threads;
+    }
+    pool = sStripPool;
+
+    decode.png = png;
+    decode.zbmp = zbmp;
+    decode.raw = (unsigned char *)malloc((size_t)png->h * png->rowBytes);
+    decode.zeros = (unsigned char *)calloc(1, png->rowBytes);
+    decode.adlers = (unsigned long *)calloc(png->stripCount, sizeof(unsigned long));
+    decode.status = (int *)calloc(png->stripCount, sizeof(int));
+
+    zWorkerPoolRun(pool, stripDecodeWork, &decode, png->stripCount);
+    zAtomicExchange(&sStripPoolBusy, 0);
+
+    // strips that leaned on the one above, in order, then the whole stream's checksum
+    adler = adler32(0L, Z_NULL, 0);
+    for(k = 0; ok && (k < png->stripCount); ++k)
+    {
+        int first = k * png->stripRows;
+        int rows = (first + png->stripRows < png->h) ? png->stripRows : (png->h - first);
+        if(decode.status[k] == 2)
+        {
+            decode.status[k] = stripUnfilter(&decode, k);
+        }
+        ok = (decode.status[k] == 1);
+        adler = adler32_combine(adler, decode.adlers[k], (z_off_t)rows * png->rowBytes);
+    }
+    ok = ok && (adler == pngRead32(png->data + png->idatSize - 4));
+
+    free(decode.raw);
+    free(decode.zeros);
+    free(decode.adlers);
+    free(decode.status);
+    zTraceEnd();
+    return ok;
+}
+
+// Picks the usual minimum-sum-of-absolute-differences filter for one RGB row. With independent set
+// only None and Sub are considered, so the row can be unfiltered without the one above. Returns the
+// filtered row (filter byte first) from candidates, which holds 5 rows of count + 1 bytes.
+static unsigned char * pngFilterRgbRow(const unsigned char *cur, const unsigned char *prev, int count, int independent, unsigned char *candidates)
+{
+    unsigned char *best = NULL;
+    unsigned long bestSum = 0;
+    int filters = independent ? 2 : 5;
+    int f, i;
+    for(f = 0; f < filters; ++f)
+    {
+        unsigned char *out = candidates + f * (count + 1);
+        unsigned long sum = 0;
+        out[0] = (unsigned char)f;
+        for(i = 0; i < count; ++i)
+        {
+            int a = (i >= 3) ? cur[i - 3] : 0;
+            int b = prev[i];
+            int c = (i >= 3) ? prev[i - 3] : 0;
+            int predicted = 0;
+            signed char v;
+            switch(f)
+            {
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) >> 1; break;
+                case 4: predicted = pngPaeth(a, b, c); break;
+            }
+            out[i + 1] = (unsigned char)(cur[i] - predicted);
+            v = (signed char)out[i + 1];
+            sum += (v < 0) ? -v : v;
+        }
+        if(!best || (sum < bestSum))
+        {
+            best = out;
+            bestSum = sum;
+        }
+    }
+    return best;
+}
+
+typedef struct DeflateOutput
+{
+    unsigned char *data;
+    size_t capacity;
+} DeflateOutput;
+
+static int deflateInto(z_stream *deflater, DeflateOutput *output, const unsigned char *in, size_t length, int flush)
+{
+    int status;
+    deflater->next_in = (Bytef *)in;
+    deflater->avail_in = (uInt)length;
+    do
+    {
+        if(deflater->total_out + 64 > output->capacity)
+        {
+            output->capacity = output->capacity * 2 + 4096;
+            output->data = (unsigned char *)realloc(output->data, output->capacity);
+        }
+        deflater->next_out = output->data + deflater->total_out;
+        deflater->avail_out = (uInt)(output->capacity - deflater->total_out);
+        status = deflate(deflater, flush);
+        if((status != Z_OK) && (status != Z_STREAM_END) && (status != Z_BUF_ERROR))
+        {
+            return 0;
+        }
+    } while((deflater->avail_out == 0) || ((flush == Z_FINISH) && (status != Z_STREAM_END)));
+    return 1;
+}
+
+static int pngWriteChunk(FILE *fp, const char *type, const unsigned char *data, size_t length)
+{
+    unsigned char header[8];
+    unsigned char footer[4];
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    pngPut32(header, (unsigned int)length);
+    memcpy(header + 4, type, 4);
+    crc = crc32(crc, header + 4, 4);
+    if(length)
+    {
+        crc = crc32(crc, data, (uInt)length);
+    }
+    pngPut32(footer, (unsigned int)crc);
+    return (fwrite(header, 1, 8, fp) == 8)
+        && (!length || (fwrite(data, 1, length, fp) == length))
+        && (fwrite(footer, 1, 4, fp) == 4);
+}
+
+int zSaveStripedPng(zBitmap *zbmp, const char *file_name, int stripRows, int level)
+{
+    static const unsigned char signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+    static const size_t idatChunk = 1 << 20;
+    DeflateOutput output = { NULL, 0 };
+    z_stream deflater;
+    unsigned char ihdr[13];
+    unsigned char *index;
+    unsigned char *rgb;
+    unsigned char *candidates;
+    int count = zbmp->w * 3;
+    int stripCount;
+    int ok = 1;
+    size_t offset;
+    FILE *fp;
+    int i, j;
+
+    if(stripRows <= 0)
+    {
+        stripRows = zbmp->h;
+    }
+    stripCount = (zbmp->h + stripRows - 1) / stripRows;
+    memset(&deflater, 0, sizeof(deflater));
+    if(deflateInit(&deflater, level) != Z_OK)
+    {
+        return 0;
+    }
+
+    zTraceBegin("zSaveStripedPng");
+    index = (unsigned char *)malloc(8 + 4 * stripCount);
+    pngPut32(index, (unsigned int)stripRows);
+    pngPut32(index + 4, (unsigned int)stripCount);
+    rgb = (unsigned char *)calloc(2, count);  // current and previous row
+    candidates = (unsigned char *)malloc(5 * (count + 1));
+    for(j = 0; ok && (j < zbmp->h); ++j)
+    {
+        unsigned char *cur = rgb + (j & 1) * count;
+        unsigned char *prev = rgb + ((j & 1) ^ 1) * count;
+        Pixel *row = &zbmp->pixels[j * zbmp->w];
+        int startsStrip = ((j % stripRows) == 0);
+        int flush = Z_NO_FLUSH;
+        for(i = 0; i < zbmp->w; ++i)
+        {
+            cur[i * 3] = row[i].r;
+            cur[i * 3 + 1] = row[i].g;
+            cur[i * 3 + 2] = row[i].b;
+        }
+        if(startsStrip)
+        {
+            // the first strip starts after the 2-byte zlib header
+            pngPut32(index + 8 + 4 * (j / stripRows), (j == 0) ? 2 : (unsigned int)deflater.total_out);
+        }
+        if(j + 1 == zbmp->h)
+        {
+            flush = Z_FINISH;
+        }
+        else if(((j + 1) % stripRows) == 0)
+        {
+            flush = Z_FULL_FLUSH;
+        }
+        ok = deflateInto(&deflater, &output, pngFilterRgbRow(cur, prev, count, startsStrip, candidates), count + 1, flush);
+    }
+    free(rgb);
+    free(candidates);
+
+    fp = ok ? fopen(file_name, "wb") : NULL;
+    if(fp)
+    {
+        pngPut32(ihdr, (unsigned int)zbmp->w);
+        pngPut32(ihdr + 4, (unsigned int)zbmp->h);
+        ihdr[8] = 8;    // bit depth
+        ihdr[9] = 2;    // truecolor
+        ihdr[10] = 0;   // deflate
+        ihdr[11] = 0;   // adaptive filtering
+        ihdr[12] = 0;   // not interlaced
+        ok = (fwrite(signature, 1, 8, fp) == 8)
+          && pngWriteChunk(fp, "IHDR", ihdr, 13)
+          && pngWriteChunk(fp, "stRP", index, 8 + 4 * stripCount);
+        for(offset = 0; ok && (offset < deflater.total_out); offset += idatChunk)
+        {
+            size_t length = deflater.total_out - offset;
+            ok = pngWriteChunk(fp, "IDAT", output.data + offset, (length < idatChunk) ? length : idatChunk);
+        }
+        ok = ok && pngWriteChunk(fp, "IEND", NULL, 0);
+        ok = (fclose(fp) == 0) && ok;
+    }
+    else
+    {
+        if(ok)
+        {
+            perror(file_name);
+        }
+        ok = 0;
+    }
+
+    deflateEnd(&deflater);
+    free(output.data);
+    free(index);
+    zTraceEnd();
+    return ok;
+}
+
+// Returns NULL whenever libpng should handle the file instead
+static zBitmap * decodeRgbPng(const char *file_name, zBitmapPool *pool)
+{
+    RgbPng png;
+    RgbPngSink sink;
+
+    if(!rgbPngOpen(&png, file_name))
+    {
+        return NULL;
+    }
+    memset(&sink, 0, sizeof(sink));
+    sink.zbmp = pool ? zBitmapPoolAcquire(pool, png.w, png.h) : zBitmapCreate(png.w, png.h);
+    if(!sink.zbmp)
+    {
+        rgbPngClose(&png);
+        return NULL;
+    }
+    if(!rgbPngDecodeStrips(&png, sink.zbmp) && !rgbPngDecode(&png, &sink))
+    {
+        if(pool)
+        {
+            zBitmapPoolRelease(pool, sink.zbmp);
+        }
+        else
+        {
+            zBitmapDestroy(sink.zbmp);
+        }
+        sink.zbmp = NULL;
+    }
+    rgbPngClose(&png);
+    return sink.zbmp;
+}
+
+static zBitmap * decodeScoreboard(const char * file_name, zBitmapPool *pool)
+{
+    zBitmap * volatile zbmp = NULL;     // volatile: still needed after libpng's longjmp
+    PngReader reader;
+    int pass;
+    int j;
+
+    if (sPngFastPath)
+    {
+        zbmp = decodeRgbPng(file_name, pool);
+        if (zbmp)
+        {
+            return zbmp;
+        }
+    }
+    if (!pngReaderOpen(&reader, file_name))
+    {
+        return 0;
+    }
+
+    // decode each row straight into its place in the bitmap, giving up on corrupt data (the
+    // setjmp in pngReaderOpen is gone with its stack frame, so this needs its own)
+    zbmp = pool ? zBitmapPoolAcquire(pool, reader.w, reader.h) : zBitmapCreate(reader.w, reader.h);
+    if (!zbmp)
+    {
+        pngReaderClose(&reader);
+        return NULL;
+    }
+    if (setjmp(png_jmpbuf(reader.png_ptr)))
+    {
+        pngReaderClose(&reader);
+        if (pool)
+        {
+            zBitmapPoolRelease(pool, zbmp);
+        }
+        else
+        {
+            zBitmapDestroy(zbmp);
+        }
+        return NULL;
+    }
+    for (pass = 0; pass < reader.passes; ++pass)
+    {
+        for (j = 0; j < reader.h; ++j)
+        {
+            png_read_row(reader.png_ptr, (png_bytep)&zbmp->pixels[j * zbmp->w], NULL);
+        }
+    }
+
+    // clean up
+    pngReaderClose(&reader);
+    return zbmp;
+}
+
+// pool may be NULL; every pixel is written, so recycled bitmaps are fine
+zBitmap * loadScoreboardPooled(const char * file_name, zBitmapPool *pool)
+{
+    zBitmap *zbmp;
+    zTraceBegin("decode");
+    zbmp = decodeScoreboard(file_name, pool);
+    zTraceEnd();
+    return zbmp;
+}
+
+zBitmap * loadScoreboard(const char * file_name)
+{
+    return loadScoreboardPooled(file_name, NULL);
+}
+
+int pixelMatchesColors(Pixel *pixel, void *userdata)
+{
+    int k;
+    struct ColorList *colorList = (struct ColorList *)userdata;
+    for(k = 0; k < colorList->count; ++k)
+    {
+        if(pixelMatches(pixel, colorList->colors[k].r, colorList->colors[k].g, colorList->colors[k].b, colorList->colors[k].a))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+struct GrayRange gChampBoxGray = { 5, 19, 80 };
+
+int pixelIsAGray(Pixel *pixel, void *userdata)
+{
+    int avg;
+    struct GrayRange *range = (struct GrayRange *)userdata;
+    if(abs(pixel->r - pixel->g) > range->tolerance) return 0;
+    if(abs(pixel->r - pixel->b) > range->tolerance) return 0;
+    if(abs(pixel->g - pixel->b) > range->tolerance) return 0;
+    avg = ((int)pixel->r + (int)pixel->g + (int)pixel->b) / 3;
+    if(avg < range->low) return 0;
+    if(avg > range->high) return 0;
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Compiled color classes
+//
+// A zColorClass is one bit per 24-bit RGB color (a 2MB cube), so a membership test is a single
+// lookup no matter how many colors or ranges were compiled into it. The index is simply the low
+// 24 bits of the BGRA dword. Classes are unions: add as many ColorLists / GrayRanges as needed.
+
+#define COLOR_CLASS_WORDS ((1 << 24) / 32)
+
+zColorClass * zColorClassCreate(void)
+{
+    zColorClass *cc = calloc(1, sizeof(zColorClass));
+    cc->bits = (unsigned int *)calloc(COLOR_CLASS_WORDS, sizeof(unsigned int));
+    return cc;
+}
+
+void zColorClassDestroy(zColorClass *cc)
+{
+    free(cc->bits);
+    free(cc);
+}
+
+static __inline unsigned int colorClassIndex(int r, int g, int b)
+{
+    return ((unsigned int)r << 16) | ((unsigned int)g << 8) | (unsigned int)b;
+}
+
+static __inline void colorClassSet(zColorClass *cc, unsigned int index)
+{
+    cc->bits[index >> 5] |= 1u << (index & 31);
+}
+
+// Same semantics as pixelMatchesColors: each color's alpha is its +/- tolerance
+void zColorClassAddColors(zColorClass *cc, struct ColorList *colorList)
+{
+    int k, r, g, b;
+    for(k = 0; k < colorList->count; ++k)
+    {
+        Pixel *c = &colorList->colors[k];
+        int t = c->a;
+        int rLo = (c->r > t) ? c->r - t : 0;
+        int gLo = (c->g > t) ? c->g - t : 0;
+        int bLo = (c->b > t) ? c->b - t : 0;
+        int rHi = (c->r + t < 255) ? c->r + t : 255;
+        int gHi = (c->g + t < 255) ? c->g + t : 255;
+        int bHi = (c->b + t < 255) ? c->b + t : 255;
+        for(r = rLo; r <= rHi; ++r)
+        {
+            for(g = gLo; g <= gHi; ++g)
+            {
+                for(b = bLo; b <= bHi; ++b)
+                {
+                    colorClassSet(cc, colorClassIndex(r, g, b));
+                }
+            }
+        }
+    }
+}
+
+// Only colors whose channels are within tolerance of r can match, so walk that band and let
+// pixelIsAGray decide the edges exactly.
+void zColorClassAddGrayRange(zColorClass *cc, struct GrayRange *range)
+{
+    int r, g, b;
+    int t = range->tolerance;
+    if(t < 0)
+    {
+        return;
+    }
+    for(r = 0; r < 256; ++r)
+    {
+        int lo = (r > t) ? r - t : 0;
+        int hi = (r + t < 255) ? r + t : 255;
+        for(g = lo; g <= hi; ++g)
+        {
+            for(b = lo; b <= hi; ++b)
+            {
+                Pixel pixel;
+                pixelSet(&pixel, r, g, b, 0);
+                if(pixelIsAGray(&pixel, range))
+                {
+                    colorClassSet(cc, colorClassIndex(r, g, b));
+                }
+            }
+        }
+    }
+}
+
+// Catch-all for predicates with no specialized compiler: evaluates func over the whole cube
+// (16M calls), so only worth it for classes that are built once and used for many frames.
+// The predicate must only look at r, g and b.
+void zColorClassAddFunc(zColorClass *cc, zFindBoxPixelMatchFunc func, void *userdata)
+{
+    int r, g, b;
+    for(r = 0; r < 256; ++r)
+    {
+        for(g = 0; g < 256; ++g)
+        {
+            for(b = 0; b < 256; ++b)
+            {
+                Pixel pixel;
+                pixelSet(&pixel, r, g, b, 0);
+                if(func(&pixel, userdata))
+                {
+                    colorClassSet(cc, colorClassIndex(r, g, b));
+                }
+            }
+        }
+    }
+}
+
+// zFindBoxPixelMatchFunc; userdata is a zColorClass
+int pixelInColorClass(Pixel *pixel, void *userdata)
+{
+    zColorClass *cc = (zColorClass *)userdata;
+    unsigned int index = colorClassIndex(pixel->r, pixel->g, pixel->b);
+    return (cc->bits[index >> 5] >> (index & 31)) & 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Row kernels for zBitmapFindBox
+//
+// pixelMatchesColors, pixelIsAGray and pixelInColorClass get whole-row kernels so FindBox doesn't
+// pay an indirect call per pixel. The SSE2/AVX2 versions classify 16/32 pixels per iteration and must agree
+// exactly with the scalar predicates; the best level the CPU supports is picked on first use.
+
+static int sKernelLevel = -1;
+
+static int detectKernelLevel(void)
+{
+#ifdef ZILEAN_X86
+    int level = Z_KERNEL_SCALAR;
+    unsigned int regs[4] = { 0 };
+    unsigned int maxLeaf;
+#if defined(_MSC_VER)
+    __cpuid((int *)regs, 0);
+    maxLeaf = regs[0];
+    __cpuid((int *)regs, 1);
+#else
+    maxLeaf = __get_cpuid_max(0, NULL);
+    __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    if(regs[3] & (1 << 26))
+    {
+        level = Z_KERNEL_SSE2;
+    }
+
+    // AVX2 also needs the OS to save ymm state (OSXSAVE + XCR0 bits 1 and 2)
+    if((maxLeaf >= 7) && (regs[2] & (1 << 27)))
+    {
+        unsigned int xcr0;
+#if defined(_MSC_VER)
+        xcr0 = (unsigned int)_xgetbv(0);
+        __cpuidex((int *)regs, 7, 0);
+#else
+        unsigned int edx;
+        __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+        __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        if(((xcr0 & 6) == 6) && (regs[1] & (1 << 5)))
+        {
+            level = Z_KERNEL_AVX2;
+        }
+    }
+    return level;
+#else
+    return Z_KERNEL_SCALAR;
+#endif
+}
+
+int zGetKernelLevel(void)
+{
+    if(sKernelLevel < 0)
+    {
+        sKernelLevel = detectKernelLevel();
+    }
+    return sKernelLevel;
+}
+
+// Clamps to what the CPU supports; returns the level actually in use. Handy for A/B timing.
+int zSetKernelLevel(int level)
+{
+    int best = detectKernelLevel();
+    if(level > best)
+    {
+        level = best;
+    }
+    if(level < Z_KERNEL_SCALAR)
+    {
+        level = Z_KERNEL_SCALAR;
+    }
+    sKernelLevel = level;
+    return sKernelLevel;
+}
+
+static int colorsRowScalar(Pixel *row, int count, void *userdata, int *colCounts)
+{
+    int i;
+    int matches = 0;
+    for(i = 0; i < count; ++i)
+    {
+        if(pixelMatchesColors(&row[i], userdata))
+        {
+            ++colCounts[i];
+            ++matches;
+        }
+    }
+    return matches;
+}
+
+static int grayRowScalar(Pixel *row, int count, void *userdata, int *colCounts)
+{
+    int i;
+    int matches = 0;
+    for(i = 0; i < count; ++i)
+    {
+        if(pixelIsAGray(&row[i], userdata))
+        {
+            ++colCounts[i];
+            ++matches;
+        }
+    }
+    return matches;
+}
+
+// Pixel is BGRA in memory, so the low 24 bits of its dword are already the cube index
+static int colorClassRow(Pixel *row, int count, void *userdata, int *colCounts)
+{
+    const unsigned int *bits = ((zColorClass *)userdata)->bits;
+    const unsigned int *src = (const unsigned int *)row;
+    int i;
+    int matches = 0;
+    for(i = 0; i < count; ++i)
+    {
+        unsigned int index = src[i] & 0xffffff;
+        int hit = (bits[index >> 5] >> (index & 31)) & 1;
+        colCounts[i] += hit;
+        matches += hit;
+    }
+    return matches;
+}
+
+// Class membership as a bitmask (bit i of mask[i >> 5] for pixel i) rather than counts, for
+// callers that keep the per-pixel answer; mask must start zeroed
+typedef void (*zColorClassMaskKernel)(Pixel *row, int count, zColorClass *cc, unsigned int *mask);
+
+static void colorClassMaskRow(Pixel *row, int count, zColorClass *cc, unsigned int *mask)
+{
+    const unsigned int *bits = cc->bits;
+    const unsigned int *src = (const unsigned int *)row;
+    int i;
+    for(i = 0; i < count; ++i)
+    {
+        unsigned int index = src[i] & 0xffffff;
+        mask[i >> 5] |= ((bits[index >> 5] >> (index & 31)) & 1) << (i & 31);
+    }
+}
+
+#ifdef ZILEAN_X86
+
+// SIMD color kernels keep their bounds on the stack; longer lists use the scalar kernel
+#define SIMD_MAX_COLORS 32
+
+// Packs each color's [c - tol, c + tol] range (saturated to 0..255, like pixelMatches' int
+// compares) as BGRA dwords. The alpha lane is left wide open so it never affects the match.
+static int packColorBounds(struct ColorList *colorList, unsigned int *lo, unsigned int *hi)
+{
+    int k;
+    if(colorList->count > SIMD_MAX_COLORS)
+    {
+        return 0;
+    }
+    for(k = 0; k < colorList->count; ++k)
+    {
+        Pixel *c = &colorList->colors[k];
+        int t = c->a;
+        int lb = (c->b > t) ? c->b - t : 0;
+        int lg = (c->g > t) ? c->g - t : 0;
+        int lr = (c->r > t) ? c->r - t : 0;
+        int hb = (c->b + t < 255) ? c->b + t : 255;
+        int hg = (c->g + t < 255) ? c->g + t : 255;
+        int hr = (c->r + t < 255) ? c->r + t : 255;
+        lo[k] = (unsigned int)lb | ((unsigned int)lg << 8) | ((unsigned int)lr << 16);
+        hi[k] = (unsigned int)hb | ((unsigned int)hg << 8) | ((unsigned int)hr << 16) | 0xff000000u;
+    }
+    return 1;
+}
+
+// avg = (r+g+b)/3 in [low, high]  <=>  r+g+b in [3*low, 3*high+2]
+static void grayRangeSumBounds(struct GrayRange *range, int *sumLo, int *sumHi)
+{
+    int low = range->low;
+    int high = range->high;
+    if(low < 0)    low = 0;
+    if(low > 256)  low = 256;
+    if(high < -1)  high = -1;
+    if(high > 255) high = 255;
+    *sumLo = low * 3;
+    *sumHi = (high * 3) + 2;
+}
+
+static __inline ZILEAN_TARGET_SSE2 __m128i colorsMatchSSE2(__m128i p, const unsigned int *lo, const unsigned int *hi, int count)
+{
+    __m128i ones = _mm_set1_epi32(-1);
+    __m128i any = _mm_setzero_si128();
+    int k;
+    for(k = 0; k < count; ++k)
+    {
+        __m128i l = _mm_set1_epi32((int)lo[k]);
+        __m128i h = _mm_set1_epi32((int)hi[k]);
+        __m128i in = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(p, l), p), _mm_cmpeq_epi8(_mm_min_epu8(p, h), p));
+        any = _mm_or_si128(any, _mm_cmpeq_epi32(in, ones));
+    }
+    return any;
+}
+
+static __inline ZILEAN_TARGET_SSE2 __m128i absDiffSSE2(__m128i a, __m128i b)
+{
+    __m128i d = _mm_sub_epi32(a, b);
+    __m128i s = _mm_srai_epi32(d, 31);
+    return _mm_sub_epi32(_mm_xor_si128(d, s), s);
+}
+
+static __inline ZILEAN_TARGET_SSE2 __m128i grayMatchSSE2(__m128i p, __m128i tol, __m128i sumLo, __m128i sumHi)
+{
+    __m128i mask = _mm_set1_epi32(0xff);
+    __m128i b = _mm_and_si128(p, mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), mask);
+    __m128i sum = _mm_add_epi32(_mm_add_epi32(r, g), b);
+    __m128i bad = _mm_cmpgt_epi32(absDiffSSE2(r, g), tol);
+    bad = _mm_or_si128(bad, _mm_cmpgt_epi32(absDiffSSE2(r, b), tol));
+    bad = _mm_or_si128(bad, _mm_cmpgt_epi32(absDiffSSE2(g, b), tol));
+    bad = _mm_or_si128(bad, _mm_cmpgt_epi32(sumLo, sum));
+    bad = _mm_or_si128(bad, _mm_cmpgt_epi32(sum, sumHi));
+    return _mm_andnot_si128(bad, _mm_set1_epi32(-1));
+}
+
+// match masks are all-ones (-1) per pixel, so subtracting them counts matches
+static __inline ZILEAN_TARGET_SSE2 void accumulateSSE2(int *colCounts, __m128i match, __m128i *rowAcc)
+{
+    __m128i cols = _mm_loadu_si128((__m128i *)colCounts);
+    _mm_storeu_si128((__m128i *)colCounts, _mm_sub_epi32(cols, match));
+    *rowAcc = _mm_sub_epi32(*rowAcc, match);
+}
+
+static __inline ZILEAN_TARGET_SSE2 int horizontalSumSSE2(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+static ZILEAN_TARGET_SSE2 int colorsRowSSE2(Pixel *row, int count, void *userdata, int *colCounts)
+{
+    struct ColorList *colorList = (struct ColorList *)userdata;
+    unsigned int lo[SIMD_MAX_COLORS];
+    unsigned int hi[SIMD_MAX_COLORS];
+    __m128i rowAcc = _mm_setzero_si128();
+    int n = colorList->count;
+    int i = 0;
+    int k;
+
+    if(!packColorBounds(colorList, lo, hi))
+    {
+        return colorsRowScalar(row, count, userdata, colCounts);
+    }
+    for(; i + 16 <= count; i += 16)
+    {
+        for(k = 0; k < 16; k += 4)
+        {
+            __m128i p = _mm_loadu_si128((__m128i *)&row[i + k]);
+            accumulateSSE2(&colCounts[i + k], colorsMatchSSE2(p, lo, hi, n), &rowAcc);
+        }
+    }
+    return horizontalSumSSE2(rowAcc) + colorsRowScalar(row + i, count - i, userdata, colCounts + i);
+}
+
+static ZILEAN_TARGET_SSE2 int grayRowSSE2(Pixel *row, int count, void *userdata, int *colCounts)
+{
+    struct GrayRange *range = (struct GrayRange *)userdata;
+    __m128i rowAcc = _mm_setzero_si128();
+    __m128i tol = _mm_set1_epi32(range->tolerance);
+    __m128i sumLo;
+    __m128i sumHi;
+    int lo, hi;
+    int i = 0;
+    int k;
+
+    grayRangeSumBounds(range, &lo, &hi);
+    sumLo = _mm_set1_epi32(lo);
+    sumHi = _mm_set1_epi32(hi);
+    for(; i + 16 <= count; i += 16)
+    {
+        for(k = 0; k < 16; k += 4)
+        {
+            __m128i p = _mm_loadu_si128((__m128i *)&row[i + k]);
+            accumulateSSE2(&colCounts[i + k], grayMatchSSE2(p, tol, sumLo, sumHi), &rowAcc);
+        }
+    }
+    return horizontalSumSSE2(rowAcc) + grayRowScalar(row + i, count - i, userdata, colCounts + i);
+}
+
+static __inline ZILEAN_TARGET_AVX2 __m256i colorsMatchAVX2(__m256i p, const unsigned int *lo, const unsigned int *hi, int count)
+{
+    __m256i ones = _mm256_set1_epi32(-1);
+    __m256i any = _mm256_setzero_si256();
+    int k;
+    for(k = 0; k < count; ++k)
+    {
+        __m256i l = _mm256_set1_epi32((int)lo[k]);
+        __m256i h = _mm256_set1_epi32((int)hi[k]);
+        __m256i in = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(p, l), p), _mm256_cmpeq_epi8(_mm256_min_epu8(p, h), p));
+        any = _mm256_or_si256(any, _mm256_cmpeq_epi32(in, ones));
+    }
+    return any;
+}
+
+static __inline ZILEAN_TARGET_AVX2 __m256i grayMatchAVX2(__m256i p, __m256i tol, __m256i sumLo, __m256i sumHi)
+{
+    __m256i mask = _mm256_set1_epi32(0xff);
+    __m256i b = _mm256_and_si256(p, mask);
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 8), mask);
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 16), mask);
+    __m256i sum = _mm256_add_epi32(_mm256_add_epi32(r, g), b);
+    __m256i bad = _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(r, g)), tol);
+    bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(r, b)), tol));
+    bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(g, b)), tol));
+    bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(sumLo, sum));
+    bad = _mm256_or_si256(bad, _mm256_cmpgt_epi32(sum, sumHi));
+    return _mm256_andnot_si256(bad, _mm256_set1_epi32(-1));
+}
+
+static __inline ZILEAN_TARGET_AVX2 void accumulateAVX2(int *colCounts, __m256i match, __m256i *rowAcc)
+{
+    __m256i cols = _mm256_loadu_si256((__m256i *)colCounts);
+    _mm256_storeu_si256((__m256i *)colCounts, _mm256_sub_epi32(cols, match));
+    *rowAcc = _mm256_sub_epi32(*rowAcc, match);
+}
+
+static __inline ZILEAN_TARGET_AVX2 int horizontalSumAVX2(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+static ZILEAN_TARGET_AVX2 int colorsRowAVX2(Pixel *row, int count, void *userdata, int *colCounts)
+{
+    struct ColorList *colorList = (struct ColorList *)userdata;
+    unsigned int lo[SIMD_MAX_COLORS];
+    unsigned int hi[SIMD_MAX_COLORS];
+    __m256i rowAcc = _mm256_setzero_si256();
+    int n = colorList->count;
+    int i = 0;
+    int k;
+
+    if(!packColorBounds(colorList, lo, hi))
+    {
+        return colorsRowScalar(row, count, userdata, colCounts);
+    }
+    for(; i + 32 <= count; i += 32)
+    {
+        for(k = 0; k < 32; k += 8)
+        {
+            __m256i p = _mm256_loadu_si256((__m256i *)&row[i + k]);
+            accumulateAVX2(&colCounts[i + k], colorsMatchAVX2(p, lo, hi, n), &rowAcc);
+        }
+    }
+    return horizontalSumAVX2(rowAcc) + colorsRowScalar(row + i, count - i, userdata, colCounts + i);
+}
+
+static ZILEAN_TARGET_AVX2 int grayRowAVX2(Pixel *row, int count, void *userdata, int *colCounts)
+{
+    struct GrayRange *range = (struct GrayRange *)userdata;
+    __m256i rowAcc = _mm256_setzero_si256();
+    __m256i tol = _mm256_set1_epi32(range->tolerance);
+    __m256i sumLo;
+    __m256i sumHi;
+    int lo, hi;
+    int i = 0;
+    int k;
+
+    grayRangeSumBounds(range, &lo, &hi);
+    sumLo = _mm256_set1_epi32(lo);
+    sumHi = _mm256_set1_epi32(hi);
+    for(; i + 32 <= count; i += 32)
+    {
+        for(k = 0; k < 32; k += 8)
+        {
+            __m256i p = _mm256_loadu_si256((__m256i *)&row[i + k]);
+            accumulateAVX2(&colCounts[i + k], grayMatchAVX2(p, tol, sumLo, sumHi), &rowAcc);
+        }
+    }
+    return horizontalSumAVX2(rowAcc) + grayRowScalar(row + i, count - i, userdata, colCounts + i);
+}
+
+static ZILEAN_TARGET_AVX2 int colorClassRowAVX2(Pixel *row, int count, void *userdata, int *colCounts)
+{
+    const int *bits = (const int *)((zColorClass *)userdata)->bits;
+    __m256i rowAcc = _mm256_setzero_si256();
+    __m256i indexMask = _mm256_set1_epi32(0xffffff);
+    __m256i bitMask = _mm256_set1_epi32(31);
+    __m256i one = _mm256_set1_epi32(1);
+    int i = 0;
+
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i index = _mm256_and_si256(_mm256_loadu_si256((__m256i *)&row[i]), indexMask);
+        __m256i words = _mm256_i32gather_epi32(bits, _mm256_srli_epi32(index, 5), 4);
+        __m256i hit = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(index, bitMask)), one);
+        __m256i cols = _mm256_loadu_si256((__m256i *)&colCounts[i]);
+        _mm256_storeu_si256((__m256i *)&colCounts[i], _mm256_add_epi32(cols, hit));
+        rowAcc = _mm256_add_epi32(rowAcc, hit);
+    }
+    return horizontalSumAVX2(rowAcc) + colorClassRow(row + i, count - i, userdata, colCounts + i);
+}
+
+// Same lookup as colorClassRowAVX2, a mask word per 32 pixels via movemask
+static ZILEAN_TARGET_AVX2 void colorClassMaskRowAVX2(Pixel *row, int count, zColorClass *cc, unsigned int *mask)
+{
+    const int *bits = (const int *)cc->bits;
+    __m256i indexMask = _mm256_set1_epi32(0xffffff);
+    __m256i bitMask = _mm256_set1_epi32(31);
+    int i = 0;
+    int k;
+
+    for(; i + 32 <= count; i += 32)
+    {
+        unsigned int word = 0;
+        for(k = 0; k < 32; k += 8)
+        {
+            __m256i index = _mm256_and_si256(_mm256_loadu_si256((__m256i *)&row[i + k]), indexMask);
+            __m256i words = _mm256_i32gather_epi32(bits, _mm256_srli_epi32(index, 5), 4);
+            __m256i hit = _mm256_sllv_epi32(words, _mm256_sub_epi32(bitMask, _mm256_and_si256(index, bitMask)));
+            word |= (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(hit)) << k;
+        }
+        mask[i >> 5] |= word;
+    }
+    colorClassMaskRow(row + i, count - i, cc, mask + (i >> 5));
+}
+
+#endif // ZILEAN_X86
+
+static zFindBoxRowKernel findBoxRowKernel(zFindBoxPixelMatchFunc func)
+{
+    int level = zGetKernelLevel();
+    if(func == pixelMatchesColors)
+    {
+#ifdef ZILEAN_X86
+        if(level >= Z_KERNEL_AVX2) return colorsRowAVX2;
+        if(level >= Z_KERNEL_SSE2) return colorsRowSSE2;
+#endif
+        return colorsRowScalar;
+    }
+    if(func == pixelIsAGray)
+    {
+#ifdef ZILEAN_X86
+        if(level >= Z_KERNEL_AVX2) return grayRowAVX2;
+        if(level >= Z_KERNEL_SSE2) return grayRowSSE2;
+#endif
+        return grayRowScalar;
+    }
+    if(func == pixelInColorClass)
+    {
+#ifdef ZILEAN_X86
+        if(level >= Z_KERNEL_AVX2) return colorClassRowAVX2;
+#endif
+        return colorClassRow;
+    }
+    return NULL;
+}
+
+static zColorClassMaskKernel colorClassMaskKernel(void)
+{
+#ifdef ZILEAN_X86
+    if(zGetKernelLevel() >= Z_KERNEL_AVX2) return colorClassMaskRowAVX2;
+#endif
+    return colorClassMaskRow;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Match tables
+//
+// A zMatchTable evaluates a predicate once over a whole bitmap and keeps the summed-area table of
+// the match mask: sums[x + y * (w+1)] is the number of matches in [0,x) x [0,y). Any rect's match
+// count is then four lookups, and the row/column projections FindBox needs are O(w+h) per query,
+// so many candidate regions can be probed per frame without touching the pixels again.
+
+zMatchTable * zMatchTableCreateView(zBitmapView *view, zFindBoxPixelMatchFunc func, void *userdata)
+{
+    int i, j;
+    int stride = view->w + 1;
+    int *mask;
+    zFindBoxRowKernel kernel = findBoxRowKernel(func);
+    zMatchTable *table = calloc(1, sizeof(zMatchTable));
+    table->w = view->w;
+    table->h = view->h;
+    table->sums = (int *)calloc(sizeof(int), stride * (view->h + 1));
+    table->colCounts = (int *)calloc(sizeof(int), view->w);
+    table->rowCounts = (int *)calloc(sizeof(int), view->h);
+
+    // the row kernels bump one counter per matching pixel, so a zeroed row comes back as its mask
+    mask = table->colCounts;
+    for (j = 0; j < view->h; ++j)
+    {
+        Pixel *row = zViewRow(view, j);
+        int *above = &table->sums[j * stride];
+        int *sums = &table->sums[(j + 1) * stride];
+        int running = 0;
+
+        memset(mask, 0, sizeof(int) * view->w);
+        if(kernel)
+        {
+            kernel(row, view->w, userdata, mask);
+        }
+        else
+        {
+            for (i = 0; i < view->w; ++i)
+            {
+                mask[i] = func(&row[i], userdata);
+            }
+        }
+        for (i = 0; i < view->w; ++i)
+        {
+            running += mask[i];
+            sums[i + 1] = above[i + 1] + running;
+        }
+    }
+    return table;
+}
+
+zMatchTable * zMatchTableCreate(zBitmap *zbmp, zFindBoxPixelMatchFunc func, void *userdata)
+{
+    zBitmapView view;
+    zBitmapGetView(zbmp, NULL, &view);
+    return zMatchTableCreateView(&view, func, userdata);
+}
+
+void zMatchTableDestroy(zMatchTable *table)
+{
+    free(table->sums);
+    free(table->colCounts);
+    free(table->rowCounts);
+    free(table);
+}
+
+// number of matches inside [left,right) x [top,bottom); rect must lie within the bitmap
+int zMatchTableCount(zMatchTable *table, RECT *rect)
+{
+    int stride = table->w + 1;
+    if((rect->left >= rect->right) || (rect->top >= rect->bottom))
+    {
+        return 0;
+    }
+    return table->sums[rect->right + (rect->bottom * stride)]
+         - table->sums[rect->left  + (rect->bottom * stride)]
+         - table->sums[rect->right + (rect->top * stride)]
+         + table->sums[rect->left  + (rect->top * stride)];
+}
+
+// Same result as zBitmapFindBox with the table's predicate, without revisiting any pixels
+int zMatchTableFindBox(zMatchTable *table, RECT *subRect, float lineToleranceX, float lineToleranceY, RECT *outputRect)
+{
+    int i, j;
+    int stride = table->w + 1;
+    const int *top;
+    const int *bottom;
+    RECT sub;
+    if(subRect)
+    {
+        memcpy(&sub, subRect, sizeof(RECT));
+    }
+    else
+    {
+        sub.left = 0;
+        sub.top = 0;
+        sub.right = table->w;
+        sub.bottom = table->h;
+    }
+
+    top = &table->sums[sub.top * stride];
+    bottom = &table->sums[sub.bottom * stride];
+    for (i = sub.left; i < sub.right; ++i)
+    {
+        table->colCounts[i] = (bottom[i + 1] - bottom[i]) - (top[i + 1] - top[i]);
+    }
+    for (j = sub.top; j < sub.bottom; ++j)
+    {
+        const int *above = &table->sums[j * stride];
+        const int *below = &table->sums[(j + 1) * stride];
+        table->rowCounts[j] = (below[sub.right] - below[sub.left]) - (above[sub.right] - above[sub.left]);
+    }
+
+    findBoxFromCounts(&sub, table->colCounts, table->rowCounts, lineToleranceX, lineToleranceY, outputRect);
+    return 1;
+}
+
+// Fills up to maxRows spans (rows may be NULL) and returns how many were found
+int findChampionRows(zBitmap *zbmp, RECT *facesBox, ChampionRow *rows, int maxRows)
+{
+    int j;
+    int count = 0;
+    int currentTop = -1;
+    zTraceBegin("findChampionRows");
+    for(j = facesBox->top; j < facesBox->bottom; ++j)
+    {
+        Pixel * pixel = &zbmp->pixels[facesBox->left + (j * zbmp->w)];
+        int isGray = pixelIsAGray(pixel, &gChampBoxGray);
+        if(isGray)
+        {
+            pixel->r = 0;
+            pixel->g = 255;
+            pixel->b = 0;
+        }
+        else
+        {
+            pixel->r = 255;
+            pixel->g = 0;
+            pixel->b = 0;
+        }
+        if(currentTop == -1)
+        {
+            if(isGray)
+            {
+                currentTop = j;
+            }
+        }
+        else
+        {
+            if(!isGray)
+            {
+                zLog("found a champion row: [%d -> %d]\n", currentTop, j);
+                if(rows && (count < maxRows))
+                {
+                    rows[count].top = currentTop;
+                    rows[count].bottom = j;
+                    ++count;
+                }
+                currentTop = -1;
+            }
+        }
+    }
+    zTraceEnd();
+    return count;
+}
+
+// Predicates used by findThings, compiled to color classes on first use (or by zScoreboardInit)
+static zColorClass *sScoreClass = NULL;
+static zColorClass *sChampBoxClass = NULL;
+
+static void buildFindThingsClasses(void)
+{
+    if(!sScoreClass)
+    {
+        Pixel scoreColors[4];
+        struct ColorList colorList;
+
+        // Rough greenish colors of outer scoreboard box
+        pixelSet(&scoreColors[0], 24, 63, 60, 4);
+        pixelSet(&scoreColors[1], 33, 69, 61, 4);
+        pixelSet(&scoreColors[2], 31, 63, 59, 7);
+        pixelSet(&scoreColors[3], 34, 74, 64, 3);
+        colorList.colors = scoreColors;
+        colorList.count = 4;
+        sScoreClass = zColorClassCreate();
+        zColorClassAddColors(sScoreClass, &colorList);
+    }
+    if(!sChampBoxClass)
+    {
+        sChampBoxClass = zColorClassCreate();
+        zColorClassAddGrayRange(sChampBoxClass, &gChampBoxGray);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Box tracking
+//
+// While the scoreboard is held open its boxes barely move between frames. A zTracker remembers the
+// last boxes along with the match count on each of their edge lines; the next frame only re-counts
+// lines within +/- band of each stored edge. If every edge still has a line scoring within slack of
+// its reference the boxes are kept (moved to the nearest such lines), otherwise the caller falls
+// back to the full search.
+
+void zTrackerInit(zTracker *tracker)
+{
+    memset(tracker, 0, sizeof(zTracker));
+    tracker->band = 3;
+    tracker->slack = 0.1f;
+}
+
+void zTrackerReset(zTracker *tracker)
+{
+    tracker->valid = 0;
+}
+
+// Matches along one edge line of box (boxes are inclusive, as FindBox returns them), moved by
+// offset lines. Returns -1 if the line falls outside the bitmap.
+static int edgeLineCount(zBitmap *zbmp, RECT *box, int edge, int offset, zFindBoxPixelMatchFunc func, void *userdata)
+{
+    int i;
+    int count = 0;
+    if((edge == EDGE_LEFT) || (edge == EDGE_RIGHT))
+    {
+        int x = ((edge == EDGE_LEFT) ? box->left : box->right) + offset;
+        if((x < 0) || (x >= zbmp->w) || (box->top < 0) || (box->bottom >= zbmp->h))
+        {
+            return -1;
+        }
+        for(i = box->top; i <= box->bottom; ++i)
+        {
+            count += func(&zbmp->pixels[x + (i * zbmp->w)], userdata) ? 1 : 0;
+        }
+    }
+    else
+    {
+        int y = ((edge == EDGE_TOP) ? box->top : box->bottom) + offset;
+        Pixel *row;
+        if((y < 0) || (y >= zbmp->h) || (box->left < 0) || (box->right >= zbmp->w))
+        {
+            return -1;
+        }
+        row = &zbmp->pixels[y * zbmp->w];
+        for(i = box->left; i <= box->right; ++i)
+        {
+            count += func(&row[i], userdata) ? 1 : 0;
+        }
+    }
+    return count;
+}
+
+static int trackableBox(zBitmap *zbmp, RECT *box)
+{
+    return (box->left < box->right) && (box->top < box->bottom)
+        && (box->left >= 0) && (box->top >= 0) && (box->right < zbmp->w) && (box->bottom < zbmp->h);
+}
+
+static int measureEdges(zBitmap *zbmp, RECT *box, zFindBoxPixelMatchFunc func, void *userdata, int *edges)
+{
+    int edge;
+    if(!trackableBox(zbmp, box))
+    {
+        return 0;
+    }
+    for(edge = 0; edge < EDGE_COUNT; ++edge)
+    {
+        edges[edge] = edgeLineCount(zbmp, box, edge, 0, func, userdata);
+        if(edges[edge] <= 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int verifyBox(zTracker *tracker, zBitmap *zbmp, RECT *box, int *edges, zFindBoxPixelMatchFunc func, void *userdata)
+{
+    int edge, step;
+    int shift[EDGE_COUNT];
+    RECT moved;
+
+    for(edge = 0; edge < EDGE_COUNT; ++edge)
+    {
+        int required = edges[edge] - (int)(edges[edge] * tracker->slack);
+        int found = 0;
+
+        // nearest lines first, so an unchanged frame keeps exactly the same box
+        for(step = 0; step <= tracker->band * 2; ++step)
+        {
+            int offset = (step & 1) ? -((step + 1) / 2) : (step / 2);
+            int count = edgeLineCount(zbmp, box, edge, offset, func, userdata);
+            if((count > 0) && (count >= required))
+            {
+                shift[edge] = offset;
+                found = 1;
+                break;
+            }
+        }
+        if(!found)
+        {
+            return 0;
+        }
+    }
+
+    moved.left = box->left + shift[EDGE_LEFT];
+    moved.top = box->top + shift[EDGE_TOP];
+    moved.right = box->right + shift[EDGE_RIGHT];
+    moved.bottom = box->bottom + shift[EDGE_BOTTOM];
+    if(!trackableBox(zbmp, &moved))
+    {
+        return 0;
+    }
+    memcpy(box, &moved, sizeof(RECT));
+    return 1;
+}
+
+// Returns 1 and fills the boxes if last frame's boxes still hold, 0 if a full search is needed
+int zTrackerVerify(zTracker *tracker, zBitmap *zbmp, RECT *scoreBox, RECT *facesBox)
+{
+    RECT score;
+    RECT faces;
+    if(tracker->valid && (tracker->w == zbmp->w) && (tracker->h == zbmp->h))
+    {
+        memcpy(&score, &tracker->scoreBox, sizeof(RECT));
+        memcpy(&faces, &tracker->facesBox, sizeof(RECT));
+        if(verifyBox(tracker, zbmp, &score, tracker->scoreEdges, pixelInColorClass, sScoreClass)
+        && verifyBox(tracker, zbmp, &faces, tracker->facesEdges, pixelInColorClass, sChampBoxClass))
+        {
+            memcpy(&tracker->scoreBox, &score, sizeof(RECT));
+            memcpy(&tracker->facesBox, &faces, sizeof(RECT));
+            memcpy(scoreBox, &score, sizeof(RECT));
+            memcpy(facesBox, &faces, sizeof(RECT));
+            ++tracker->hits;
+            return 1;
+        }
+    }
+    tracker->valid = 0;
+    ++tracker->misses;
+    return 0;
+}
+
+// Remembers the boxes from a full search; boxes without solid edges aren't tracked
+void zTrackerUpdate(zTracker *tracker, zBitmap *zbmp, RECT *scoreBox, RECT *facesBox)
+{
+    tracker->w = zbmp->w;
+    tracker->h = zbmp->h;
+    memcpy(&tracker->scoreBox, scoreBox, sizeof(RECT));
+    memcpy(&tracker->facesBox, facesBox, sizeof(RECT));
+    tracker->valid = measureEdges(zbmp, scoreBox, pixelInColorClass, sScoreClass, tracker->scoreEdges)
+                  && measureEdges(zbmp, facesBox, pixelInColorClass, sChampBoxClass, tracker->facesEdges);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+static void searchScoreboardBoxes(zBitmap *zbmp, RECT *scoreBox, RECT *facesBox, zScoreboardInfo *info)
+{
+    RECT subBox;
+    zStageMark mark;
+
+    zStageBegin(&mark);
+    zBitmapFindBox(zbmp, NULL, pixelInColorClass, sScoreClass, 0.5f, 0.9f, scoreBox, 0);
+    zStageEnd(&mark, info, Z_STAGE_SCOREBOX);
+    zStageBegin(&mark);
+    zLog("scorebox location: [%d, %d, %d, %d]\n", scoreBox->left, scoreBox->top, scoreBox->right, scoreBox->bottom);
+    //zBitmapBox(zbmp, scoreBox, 255, 255, 0);
+
+    memcpy(&subBox, scoreBox, sizeof(RECT));
+    subBox.right = subBox.left + ((subBox.right - subBox.left) / 8); // facesBox will be in the first 1/8th
+    zLog("sub location: [%d, %d, %d, %d]\n", subBox.left, subBox.top, subBox.right, subBox.bottom);
+    //zBitmapBox(zbmp, &subBox, 255, 128, 0);
+    zBitmapFindBox(zbmp, &subBox, pixelInColorClass, sChampBoxClass, 0.7f, 0.4f, facesBox, 0);
+    zStageEnd(&mark, info, Z_STAGE_FACESBOX);
+    zLog("facesbox location: [%d, %d, %d, %d]\n", facesBox->left, facesBox->top, facesBox->right, facesBox->bottom);
+    //zBitmapBox(zbmp, facesBox, 255, 0, 255);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Layout cache
+//
+// Clients run at a handful of fixed resolutions and, for a given one, the scoreboard is always laid
+// out the same way. The cache keeps the first good detection per frame size; later frames of that
+// size only probe the scorebox's four edge lines and then go straight to champion row extraction.
+// A failed probe drops the entry and the next full search replaces it. The cache can be saved to
+// and loaded from a small text file so it survives restarts.
+
+zLayoutCache * zLayoutCacheCreate(void)
+{
+    zLayoutCache *cache = calloc(1, sizeof(zLayoutCache));
+    cache->slack = 0.1f;
+    return cache;
+}
+
+void zLayoutCacheDestroy(zLayoutCache *cache)
+{
+    free(cache->layouts);
+    free(cache);
+}
+
+static zLayout * layoutCacheFind(zLayoutCache *cache, int w, int h)
+{
+    int i;
+    for(i = 0; i < cache->count; ++i)
+    {
+        if((cache->layouts[i].w == w) && (cache->layouts[i].h == h))
+        {
+            return &cache->layouts[i];
+        }
+    }
+    return NULL;
+}
+
+static void layoutCacheRemove(zLayoutCache *cache, zLayout *layout)
+{
+    int index = (int)(layout - cache->layouts);
+    memmove(&cache->layouts[index], &cache->layouts[index + 1], (cache->count - index - 1) * sizeof(zLayout));
+    --cache->count;
+}
+
+static zLayout * layoutCacheAdd(zLayoutCache *cache, int w, int h)
+{
+    zLayout *layout = layoutCacheFind(cache, w, h);
+    if(!layout)
+    {
+        if(cache->count == cache->capacity)
+        {
+            cache->capacity = cache->capacity ? cache->capacity * 2 : 4;
+            cache->layouts = (zLayout *)realloc(cache->layouts, cache->capacity * sizeof(zLayout));
+        }
+        layout = &cache->layouts[cache->count++];
+    }
+    memset(layout, 0, sizeof(zLayout));
+    layout->w = w;
+    layout->h = h;
+    return layout;
+}
+
+// the cheap check: the scorebox's edge lines must still score within slack of the stored counts
+static int layoutProbe(zLayoutCache *cache, zLayout *layout, zBitmap *zbmp)
+{
+    int edge;
+    for(edge = 0; edge < EDGE_COUNT; ++edge)
+    {
+        int required = layout->scoreEdges[edge] - (int)(layout->scoreEdges[edge] * cache->slack);
+        int count = edgeLineCount(zbmp, &layout->scoreBox, edge, 0, pixelInColorClass, sScoreClass);
+        if((count <= 0) || (count < required))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int zLayoutCacheSave(zLayoutCache *cache, const char *filename)
+{
+    int i, k;
+    FILE *f = fopen(filename, "w");
+    if(!f)
+    {
+        perror(filename);
+        return 0;
+    }
+    for(i = 0; i < cache->count; ++i)
+    {
+        zLayout *l = &cache->layouts[i];
+        fprintf(f, "%d %d  %d %d %d %d  %d %d %d %d  %d %d %d %d  %d",
+            l->w, l->h,
+            (int)l->scoreBox.left, (int)l->scoreBox.top, (int)l->scoreBox.right, (int)l->scoreBox.bottom,
+            (int)l->facesBox.left, (int)l->facesBox.top, (int)l->facesBox.right, (int)l->facesBox.bottom,
+            l->scoreEdges[0], l->scoreEdges[1], l->scoreEdges[2], l->scoreEdges[3],
+            l->rowCount);
+        for(k = 0; k < l->rowCount; ++k)
+        {
+            fprintf(f, " %d %d", l->rows[k].top, l->rows[k].bottom);
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return 1;
+}
+
+// box is left, top, right, bottom, all inclusive, as the cache uses them to index pixels
+static int layoutBoxValid(const int *box, int w, int h)
+{
+    return (box[0] >= 0) && (box[0] < box[2]) && (box[2] < w)
+        && (box[1] >= 0) && (box[1] < box[3]) && (box[3] < h);
+}
+
+// merges the file's layouts into the cache; returns 0 if it couldn't be read or any layout in it
+// doesn't fit its own frame size (the layouts before that one are kept)
+int zLayoutCacheLoad(zLayoutCache *cache, const char *filename)
+{
+    zLayout l;
+    int box[8];
+    int k;
+    FILE *f = fopen(filename, "r");
+    if(!f)
+    {
+        return 0;
+    }
+    while(fscanf(f, "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+        &l.w, &l.h, &box[0], &box[1], &box[2], &box[3], &box[4], &box[5], &box[6], &box[7],
+        &l.scoreEdges[0], &l.scoreEdges[1], &l.scoreEdges[2], &l.scoreEdges[3], &l.rowCount) == 15)
+    {
+        zLayout *layout;
+        if((l.rowCount < 0) || (l.rowCount > MAX_CHAMPION_ROWS)
+        || !layoutBoxValid(&box[0], l.w, l.h) || !layoutBoxValid(&box[4], l.w, l.h))
+        {
+            fclose(f);
+            return 0;
+        }
+        for(k = 0; k < l.rowCount; ++k)
+        {
+            if((fscanf(f, "%d %d", &l.rows[k].top, &l.rows[k].bottom) != 2)
+            || (l.rows[k].top < 0) || (l.rows[k].top > l.rows[k].bottom) || (l.rows[k].bottom > l.h))
+            {
+                fclose(f);
+                return 0;
+            }
+        }
+        layout = layoutCacheAdd(cache, l.w, l.h);
+        memcpy(layout, &l, sizeof(zLayout));
+        layout->scoreBox.left = box[0];
+        layout->scoreBox.top = box[1];
+        layout->scoreBox.right = box[2];
+        layout->scoreBox.bottom = box[3];
+        layout->facesBox.left = box[4];
+        layout->facesBox.top = box[5];
+        layout->facesBox.right = box[6];
+        layout->facesBox.bottom = box[7];
+    }
+    fclose(f);
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+const char *zStageNames[Z_STAGE_COUNT] = { "decode", "scorebox", "facesbox", "rows" };
+const char *zCounterNames[Z_COUNTER_COUNT] = { "cycles", "instructions", "cacheMisses", "branchMisses" };
+
+// One perf event group per thread: cycles leads, so all four are scheduled together and come
+// back from a single read().
+typedef struct zCounterGroup
+{
+    int state; // 0 not opened yet, 1 open, -1 failed
+    int fds[Z_COUNTER_COUNT];
+} zCounterGroup;
+
+static volatile int sCountersEnabled = 0;
+static ZILEAN_THREAD_LOCAL zCounterGroup sThreadCounters = { 0 };
+
+#ifdef __linux__
+static int counterGroupOpen(zCounterGroup *group)
+{
+    static const unsigned long long configs[Z_COUNTER_COUNT] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    int k;
+    for(k = 0; k < Z_COUNTER_COUNT; ++k)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[k];
+        attr.disabled = (k == 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        group->fds[k] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, (k == 0) ? -1 : group->fds[0], 0);
+        if(group->fds[k] < 0)
+        {
+            while(k-- > 0)
+            {
+                close(group->fds[k]);
+            }
+            group->state = -1;
+            return 0;
+        }
+    }
+    ioctl(group->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    group->state = 1;
+    return 1;
+}
+
+// raw counts plus how long the group was enabled and actually on the PMU, for zStageEnd to scale
+static void counterGroupRead(zCounterGroup *group, zStageMark *mark)
+{
+    unsigned long long data[3 + Z_COUNTER_COUNT];
+    if(read(group->fds[0], data, sizeof(data)) != sizeof(data))
+    {
+        memset(data, 0, sizeof(data));
+    }
+    memcpy(mark->counters, &data[3], sizeof(mark->counters));
+    mark->timeEnabled = data[1];
+    mark->timeRunning = data[2];
+}
+#else
+static int counterGroupOpen(zCounterGroup *group)
+{
+    group->state = -1;
+    return 0;
+}
+
+static void counterGroupRead(zCounterGroup *group, zStageMark *mark)
+{
+    memset(mark->counters, 0, sizeof(mark->counters));
+    mark->timeEnabled = 0;
+    mark->timeRunning = 0;
+}
+#endif
+
+static int threadCountersReady(void)
+{
+    if(!sCountersEnabled)
+    {
+        return 0;
+    }
+    if(sThreadCounters.state == 0)
+    {
+        counterGroupOpen(&sThreadCounters);
+    }
+    return (sThreadCounters.state == 1);
+}
+
+int zCountersEnable(void)
+{
+    sCountersEnabled = 1;
+    if(!threadCountersReady())
+    {
+        sCountersEnabled = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void zStageBegin(zStageMark *mark)
+{
+    if(threadCountersReady())
+    {
+        counterGroupRead(&sThreadCounters, mark);
+    }
+    else
+    {
+        memset(mark->counters, 0, sizeof(mark->counters));
+        mark->timeEnabled = 0;
+        mark->timeRunning = 0;
+    }
+    mark->start = zTimeNow();
+}
+
+void zStageEnd(zStageMark *mark, zScoreboardInfo *info, int stage)
+{
+    int k;
+    info->stageMs[stage] = zTimeNow() - mark->start;
+    if(threadCountersReady())
+    {
+        // deltas of the raw counts, scaled up once by the stage's own share of PMU time if the
+        // group was multiplexed off it (and 0 if it never got on)
+        zStageMark now;
+        unsigned long long enabled, running;
+        counterGroupRead(&sThreadCounters, &now);
+        enabled = (now.timeEnabled > mark->timeEnabled) ? (now.timeEnabled - mark->timeEnabled) : 0;
+        running = (now.timeRunning > mark->timeRunning) ? (now.timeRunning - mark->timeRunning) : 0;
+        for(k = 0; k < Z_COUNTER_COUNT; ++k)
+        {
+            unsigned long long delta = (now.counters[k] > mark->counters[k]) ? (now.counters[k] - mark->counters[k]) : 0;
+            if(running == 0)
+            {
+                delta = 0;
+            }
+            else if(running < enabled)
+            {
+                delta = (unsigned long long)((double)delta * enabled / running);
+            }
+            info->stageCounters[stage][k] = delta;
+        }
+    }
+    else
+    {
+        memset(info->stageCounters[stage], 0, sizeof(info->stageCounters[stage]));
+    }
+}
+
+void zScoreboardInit(void)
+{
+    buildFindThingsClasses();
+    zGetKernelLevel();
+}
+
+// Finds the scoreboard boxes and champion rows. Either helper may be NULL: a layout cache hit skips
+// box detection altogether, a tracker hit replaces the full search with a band check.
+void findScoreboard(zBitmap *zbmp, zTracker *tracker, zLayoutCache *cache, zScoreboardInfo *info)
+{
+    zLayout *layout = NULL;
+    zStageMark mark;
+
+    zTraceBegin("findScoreboard");
+    buildFindThingsClasses();
+    info->stageMs[Z_STAGE_FACESBOX] = 0.0;
+    memset(info->stageCounters[Z_STAGE_FACESBOX], 0, sizeof(info->stageCounters[Z_STAGE_FACESBOX]));
+    zStageBegin(&mark);
+    if(cache)
+    {
+        zTraceBegin("layout probe");
+        layout = layoutCacheFind(cache, zbmp->w, zbmp->h);
+        if(layout && !layoutProbe(cache, layout, zbmp))
+        {
+            layoutCacheRemove(cache, layout);
+            ++cache->invalidations;
+            layout = NULL;
+        }
+        if(layout)
+        {
+            ++cache->hits;
+        }
+        else
+        {
+            ++cache->misses;
+        }
+        zTraceEnd();
+    }
+
+    if(layout)
+    {
+        memcpy(&info->scoreBox, &layout->scoreBox, sizeof(RECT));
+        memcpy(&info->facesBox, &layout->facesBox, sizeof(RECT));
+        zStageEnd(&mark, info, Z_STAGE_SCOREBOX);
+        zLog("cached scorebox: [%d, %d, %d, %d]\n", info->scoreBox.left, info->scoreBox.top, info->scoreBox.right, info->scoreBox.bottom);
+    }
+    else if(tracker && zTrackerVerify(tracker, zbmp, &info->scoreBox, &info->facesBox))
+    {
+        zStageEnd(&mark, info, Z_STAGE_SCOREBOX);
+        zLog("tracked scorebox: [%d, %d, %d, %d]\n", info->scoreBox.left, info->scoreBox.top, info->scoreBox.right, info->scoreBox.bottom);
+        zLog("tracked facesbox: [%d, %d, %d, %d]\n", info->facesBox.left, info->facesBox.top, info->facesBox.right, info->facesBox.bottom);
+    }
+    else
+    {
+        searchScoreboardBoxes(zbmp, &info->scoreBox, &info->facesBox, info);
+        if(tracker)
+        {
+            zTrackerUpdate(tracker, zbmp, &info->scoreBox, &info->facesBox);
+        }
+    }
+
+    zStageBegin(&mark);
+    info->rowCount = findChampionRows(zbmp, &info->facesBox, info->rows, MAX_CHAMPION_ROWS);
+    zStageEnd(&mark, info, Z_STAGE_ROWS);
+
+    // only a detection with solid scorebox edges and some champion rows is worth remembering
+    if(cache && !layout && (info->rowCount > 0))
+    {
+        zLayout candidate;
+        if(measureEdges(zbmp, &info->scoreBox, pixelInColorClass, sScoreClass, candidate.scoreEdges))
+        {
+            layout = layoutCacheAdd(cache, zbmp->w, zbmp->h);
+            memcpy(&layout->scoreBox, &info->scoreBox, sizeof(RECT));
+            memcpy(&layout->facesBox, &info->facesBox, sizeof(RECT));
+            memcpy(layout->scoreEdges, candidate.scoreEdges, sizeof(candidate.scoreEdges));
+            layout->rowCount = info->rowCount;
+            memcpy(layout->rows, info->rows, info->rowCount * sizeof(ChampionRow));
+        }
+    }
+    zTraceEnd();
+}
+
+void findThings(zBitmap *zbmp)
+{
+    zScoreboardInfo info;
+    findScoreboard(zbmp, NULL, NULL, &info);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Streaming analysis
+
+// same test findBoxFromCounts applies to the scorebox rows
+#define STREAM_SCORE_TOLERANCE_Y 0.9f
+
+zStreamAnalyzer * zStreamAnalyzerCreate(int w, int h, int earlyStop)
+{
+    zStreamAnalyzer *stream = calloc(1, sizeof(zStreamAnalyzer));
+    buildFindThingsClasses();
+    stream->w = w;
+    stream->h = h;
+    stream->earlyStop = earlyStop;
+    stream->colCounts = (int *)calloc(sizeof(int), w);
+    stream->rowCounts = (int *)calloc(sizeof(int), h);
+    stream->maskWords = (w + 31) / 32;
+    stream->grayMask = (unsigned int *)calloc(sizeof(unsigned int), (size_t)stream->maskWords * h);
+    stream->topRow = -1;
+    stream->bottomRow = -1;
+    return stream;
+}
+
+void zStreamAnalyzerDestroy(zStreamAnalyzer *stream)
+{
+    free(stream->colCounts);
+    free(stream->rowCounts);
+    free(stream->grayMask);
+    free(stream);
+}
+
+static int streamRowIsEdge(zStreamAnalyzer *stream, int j)
+{
+    int best = stream->bestRowCount;
+    return (best > 0) && closeEnough(stream->rowCounts[j], best, best - (best * STREAM_SCORE_TOLERANCE_Y));
+}
+
+// Tracks the first and last rows that would currently pass as scorebox edges. A new best row can
+// disqualify earlier candidates, so that (rare) case rescans the rows seen so far.
+static void streamTrackEdges(zStreamAnalyzer *stream, int j)
+{
+    int k;
+    if(stream->rowCounts[j] > stream->bestRowCount)
+    {
+        stream->bestRowCount = stream->rowCounts[j];
+        stream->topRow = -1;
+        stream->bottomRow = -1;
+        for(k = 0; k <= j; ++k)
+        {
+            if(streamRowIsEdge(stream, k))
+            {
+                if(stream->topRow < 0)
+                {
+                    stream->topRow = k;
+                }
+                stream->bottomRow = k;
+            }
+        }
+    }
+    else if(streamRowIsEdge(stream, j))
+    {
+        if(stream->topRow < 0)
+        {
+            stream->topRow = j;
+        }
+        stream->bottomRow = j;
+    }
+}
+
+// Done once the candidate box is reasonably tall and a quarter of its height has gone by below the
+// bottom edge without another edge-strength row (which would have moved the bottom down).
+static int streamPastBottom(zStreamAnalyzer *stream, int j)
+{
+    int height = stream->bottomRow - stream->topRow;
+    int margin = height / 4;
+    if((stream->topRow < 0) || (height < stream->h / 8))
+    {
+        return 0;
+    }
+    if(margin < 16)
+    {
+        margin = 16;
+    }
+    return (j - stream->bottomRow) >= margin;
+}
+
+int zStreamAnalyzerPushRow(zStreamAnalyzer *stream, Pixel *row)
+{
+    zFindBoxRowKernel kernel = findBoxRowKernel(pixelInColorClass);
+    zColorClassMaskKernel maskKernel = colorClassMaskKernel();
+    double start = zTimeNow();
+    int j = stream->rowsPushed;
+
+    if(j >= stream->h)
+    {
+        return 0;
+    }
+    stream->rowCounts[j] = kernel(row, stream->w, sScoreClass, stream->colCounts);
+
+    maskKernel(row, stream->w, sChampBoxClass, &stream->grayMask[(size_t)j * stream->maskWords]);
+
+    ++stream->rowsPushed;
+    streamTrackEdges(stream, j);
+    stream->classifyMs += zTimeNow() - start;
+    if(stream->rowsPushed >= stream->h)
+    {
+        return 0;
+    }
+    return !(stream->earlyStop && streamPastBottom(stream, j));
+}
+
+static __inline int streamGrayAt(zStreamAnalyzer *stream, int i, int j)
+{
+    if((i < 0) || (i >= stream->w) || (j < 0) || (j >= stream->h))
+    {
+        return 0;
+    }
+    return (stream->grayMask[(size_t)j * stream->maskWords + (i >> 5)] >> (i & 31)) & 1;
+}
+
+// The same three steps as findScoreboard's full search, read off the histograms and the mask
+void zStreamAnalyzerFinish(zStreamAnalyzer *stream, zScoreboardInfo *info)
+{
+    RECT sub;
+    RECT subBox;
+    int *colCounts;
+    int *rowCounts;
+    int currentTop = -1;
+    double start;
+    int i, j;
+
+    zTraceBegin("zStreamAnalyzerFinish");
+    memset(info->stageCounters, 0, sizeof(info->stageCounters));
+    start = zTimeNow();
+    sub.left = 0;
+    sub.top = 0;
+    sub.right = stream->w;
+    sub.bottom = stream->h;
+    findBoxFromCounts(&sub, stream->colCounts, stream->rowCounts, 0.5f, STREAM_SCORE_TOLERANCE_Y, &info->scoreBox);
+    info->stageMs[Z_STAGE_SCOREBOX] = stream->classifyMs + (zTimeNow() - start);
+    zLog("scorebox location: [%d, %d, %d, %d]\n", info->scoreBox.left, info->scoreBox.top, info->scoreBox.right, info->scoreBox.bottom);
+
+    start = zTimeNow();
+    memcpy(&subBox, &info->scoreBox, sizeof(RECT));
+    subBox.right = subBox.left + ((subBox.right - subBox.left) / 8); // facesBox will be in the first 1/8th
+    colCounts = (int *)calloc(sizeof(int), stream->w);
+    rowCounts = (int *)calloc(sizeof(int), stream->h);
+    for(j = subBox.top; j < subBox.bottom; ++j)
+    {
+        for(i = subBox.left; i < subBox.right; ++i)
+        {
+            if(streamGrayAt(stream, i, j))
+            {
+                ++colCounts[i];
+                ++rowCounts[j];
+            }
+        }
+    }
+    findBoxFromCounts(&subBox, colCounts, rowCounts, 0.7f, 0.4f, &info->facesBox);
+    free(colCounts);
+    free(rowCounts);
+    info->stageMs[Z_STAGE_FACESBOX] = zTimeNow() - start;
+    zLog("facesbox location: [%d, %d, %d, %d]\n", info->facesBox.left, info->facesBox.top, info->facesBox.right, info->facesBox.bottom);
+
+    // findChampionRows without the debug paint
+    start = zTimeNow();
+    info->rowCount = 0;
+    for(j = info->facesBox.top; j < info->facesBox.bottom; ++j)
+    {
+        int isGray = streamGrayAt(stream, info->facesBox.left, j);
+        if(currentTop == -1)
+        {
+            if(isGray)
+            {
+                currentTop = j;
+            }
+        }
+        else if(!isGray)
+        {
+            if(info->rowCount < MAX_CHAMPION_ROWS)
+            {
+                info->rows[info->rowCount].top = currentTop;
+                info->rows[info->rowCount].bottom = j;
+                ++info->rowCount;
+            }
+            currentTop = -1;
+        }
+    }
+    info->stageMs[Z_STAGE_ROWS] = zTimeNow() - start;
+    zTraceEnd();
+}
+
+// The fast path's decoder (pipelined or not) straight into the analyzer; NULL if libpng should
+// handle the file instead
+static zStreamAnalyzer * streamRgbPng(const char *file_name, int flags, int *rowsDecoded, double *decodeMs)
+{
+    RgbPng png;
+    RgbPngSink sink;
+    double start = zTimeNow();
+
+    if(!sPngFastPath || !rgbPngOpen(&png, file_name))
+    {
+        return NULL;
+    }
+    memset(&sink, 0, sizeof(sink));
+    sink.stream = zStreamAnalyzerCreate(png.w, png.h, flags & Z_STREAM_EARLY_STOP);
+    if(!rgbPngDecode(&png, &sink))
+    {
+        zStreamAnalyzerDestroy(sink.stream);
+        sink.stream = NULL;
+    }
+    rgbPngClose(&png);
+    if(sink.stream)
+    {
+        *rowsDecoded = sink.rowsDecoded;
+        *decodeMs = (zTimeNow() - start) - sink.stream->classifyMs;
+    }
+    return sink.stream;
+}
+
+static zStreamAnalyzer * streamLibpng(const char *file_name, int flags, int *rowsDecoded, double *decodeMs)
+{
+    zStreamAnalyzer *stream;
+    PngReader reader;
+    zBitmap * volatile zbmp = NULL;     // interlaced images are decoded whole first
+    Pixel * volatile row = NULL;        // volatile: both are still needed after libpng's longjmp
+    double start = zTimeNow();
+
+    *decodeMs = 0.0;
+    *rowsDecoded = 0;
+    if(!pngReaderOpen(&reader, file_name))
+    {
+        return NULL;
+    }
+    stream = zStreamAnalyzerCreate(reader.w, reader.h, flags & Z_STREAM_EARLY_STOP);
+    if(reader.passes > 1)
+    {
+        zbmp = zBitmapCreate(reader.w, reader.h);
+    }
+    else
+    {
+        row = (Pixel *)malloc(reader.w * sizeof(Pixel));
+    }
+    *decodeMs += zTimeNow() - start;
+    if(!zbmp && !row)
+    {
+        zStreamAnalyzerDestroy(stream);
+        pngReaderClose(&reader);
+        return NULL;
+    }
+
+    // corrupt data: everything allocated above is still what these point at
+    if(setjmp(png_jmpbuf(reader.png_ptr)))
+    {
+        if(zbmp)
+        {
+            zBitmapDestroy(zbmp);
+        }
+        free(row);
+        zStreamAnalyzerDestroy(stream);
+        pngReaderClose(&reader);
+        return NULL;
+    }
+
+    if(zbmp)
+    {
+        int pass, j;
+        start = zTimeNow();
+        for(pass = 0; pass < reader.passes; ++pass)
+        {
+            for(j = 0; j < reader.h; ++j)
+            {
+                png_read_row(reader.png_ptr, (png_bytep)&zbmp->pixels[j * zbmp->w], NULL);
+            }
+        }
+        *rowsDecoded = reader.h;
+        *decodeMs += zTimeNow() - start;
+        for(j = 0; j < reader.h; ++j)
+        {
+            if(!zStreamAnalyzerPushRow(stream, &zbmp->pixels[j * zbmp->w]))
+            {
+                break;
+            }
+        }
+        zBitmapDestroy(zbmp);
+    }
+    else
+    {
+        do
+        {
+            start = zTimeNow();
+            png_read_row(reader.png_ptr, (png_bytep)row, NULL);
+            *decodeMs += zTimeNow() - start;
+            ++*rowsDecoded;
+        } while(zStreamAnalyzerPushRow(stream, row));
+        free(row);
+    }
+
+    start = zTimeNow();
+    pngReaderClose(&reader);
+    *decodeMs += zTimeNow() - start;
+    return stream;
+}
+
+int loadScoreboardStreaming(const char *file_name, int flags, zScoreboardInfo *info, zStreamStats *stats)
+{
+    zStreamAnalyzer *stream;
+    double decodeMs = 0.0;
+    int rowsDecoded = 0;
+
+    zTraceBegin("loadScoreboardStreaming");
+    stream = streamRgbPng(file_name, flags, &rowsDecoded, &decodeMs);
+    if(!stream)
+    {
+        stream = streamLibpng(file_name, flags, &rowsDecoded, &decodeMs);
+    }
+    if(!stream)
+    {
+        zTraceEnd();
+        return 0;
+    }
+
+    zStreamAnalyzerFinish(stream, info);
+    info->stageMs[Z_STAGE_DECODE] = decodeMs;
+    if(stats)
+    {
+        stats->w = stream->w;
+        stats->h = stream->h;
+        stats->rowsDecoded = rowsDecoded;
+    }
+    zStreamAnalyzerDestroy(stream);
+    zTraceEnd();
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Frame differencing
+//
+// Frames are cut into Z_DIFF_TILE square tiles and each tile gets a 32-bit hash. Within a tile every
+// pixel column x keeps its own multiply-xorshift state, s[x] = mix((s[x] ^ pixel) * K), fed one row
+// at a time; the 32 column states are folded FNV-style at the end. Column states are independent,
+// so the SSE2/AVX2 versions update 4/8 of them per instruction and give exactly the scalar hash.
+// Partial tiles at the right edge leave their missing columns at the seed.
+
+#define DIFF_SEED  0x811c9dc5u
+#define DIFF_MUL   0x9e3779b1u
+
+static unsigned int diffFold(const unsigned int *states)
+{
+    unsigned int h = DIFF_SEED;
+    int x;
+    for(x = 0; x < Z_DIFF_TILE; ++x)
+    {
+        h = (h ^ states[x]) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned int diffTileScalar(const Pixel *tile, int stride, int tw, int th)
+{
+    unsigned int states[Z_DIFF_TILE];
+    int x, y;
+    for(x = 0; x < Z_DIFF_TILE; ++x)
+    {
+        states[x] = DIFF_SEED;
+    }
+    for(y = 0; y < th; ++y)
+    {
+        const unsigned int *row = (const unsigned int *)(tile + (y * stride));
+        for(x = 0; x < tw; ++x)
+        {
+            unsigned int s = (states[x] ^ row[x]) * DIFF_MUL;
+            states[x] = s ^ (s >> 15);
+        }
+    }
+    return diffFold(states);
+}
+
+#ifdef ZILEAN_X86
+
+// SSE2 has no 32-bit low multiply; build it from the two even/odd 32x32->64 products
+static __inline ZILEAN_TARGET_SSE2 __m128i mulloSSE2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// full-width tiles only
+static ZILEAN_TARGET_SSE2 unsigned int diffTileSSE2(const Pixel *tile, int stride, int th)
+{
+    unsigned int states[Z_DIFF_TILE];
+    __m128i s[Z_DIFF_TILE / 4];
+    __m128i mul = _mm_set1_epi32((int)DIFF_MUL);
+    int k, y;
+    for(k = 0; k < Z_DIFF_TILE / 4; ++k)
+    {
+        s[k] = _mm_set1_epi32((int)DIFF_SEED);
+    }
+    for(y = 0; y < th; ++y)
+    {
+        const __m128i *row = (const __m128i *)(tile + (y * stride));
+        for(k = 0; k < Z_DIFF_TILE / 4; ++k)
+        {
+            __m128i v = mulloSSE2(_mm_xor_si128(s[k], _mm_loadu_si128(row + k)), mul);
+            s[k] = _mm_xor_si128(v, _mm_srli_epi32(v, 15));
+        }
+    }
+    for(k = 0; k < Z_DIFF_TILE / 4; ++k)
+    {
+        _mm_storeu_si128((__m128i *)&states[k * 4], s[k]);
+    }
+    return diffFold(states);
+}
+
+static ZILEAN_TARGET_AVX2 unsigned int diffTileAVX2(const Pixel *tile, int stride, int th)
+{
+    unsigned int states[Z_DIFF_TILE];
+    __m256i s[Z_DIFF_TILE / 8];
+    __m256i mul = _mm256_set1_epi32((int)DIFF_MUL);
+    int k, y;
+    for(k = 0; k < Z_DIFF_TILE / 8; ++k)
+    {
+        s[k] = _mm256_set1_epi32((int)DIFF_SEED);
+    }
+    for(y = 0; y < th; ++y)
+    {
+        const __m256i *row = (const __m256i *)(tile + (y * stride));
+        for(k = 0; k < Z_DIFF_TILE / 8; ++k)
+        {
+            __m256i v = _mm256_mullo_epi32(_mm256_xor_si256(s[k], _mm256_loadu_si256(row + k)), mul);
+            s[k] = _mm256_xor_si256(v, _mm256_srli_epi32(v, 15));
+        }
+    }
+    for(k = 0; k < Z_DIFF_TILE / 8; ++k)
+    {
+        _mm256_storeu_si256((__m256i *)&states[k * 8], s[k]);
+    }
+    return diffFold(states);
+}
+
+#endif // ZILEAN_X86
+
+zFrameDiff * zFrameDiffCreate(void)
+{
+    return calloc(1, sizeof(zFrameDiff));
+}
+
+void zFrameDiffDestroy(zFrameDiff *diff)
+{
+    free(diff->hashes);
+    free(diff->changed);
+    free(diff);
+}
+
+int zFrameDiffUpdate(zFrameDiff *diff, zBitmap *zbmp)
+{
+    int changedCount = 0;
+    int tx, ty;
+    double start = zTimeNow();
+
+    zTraceBegin("tile hash");
+    if(!diff->valid || (diff->w != zbmp->w) || (diff->h != zbmp->h))
+    {
+        diff->w = zbmp->w;
+        diff->h = zbmp->h;
+        diff->tilesX = (zbmp->w + Z_DIFF_TILE - 1) / Z_DIFF_TILE;
+        diff->tilesY = (zbmp->h + Z_DIFF_TILE - 1) / Z_DIFF_TILE;
+        free(diff->hashes);
+        free(diff->changed);
+        diff->hashes = (unsigned int *)calloc(diff->tilesX * diff->tilesY, sizeof(unsigned int));
+        diff->changed = (unsigned char *)malloc(diff->tilesX * diff->tilesY);
+        memset(diff->changed, 1, diff->tilesX * diff->tilesY);
+        changedCount = -1;
+    }
+
+    for(ty = 0; ty < diff->tilesY; ++ty)
+    {
+        int th = zbmp->h - (ty * Z_DIFF_TILE);
+        if(th > Z_DIFF_TILE)
+        {
+            th = Z_DIFF_TILE;
+        }
+        for(tx = 0; tx < diff->tilesX; ++tx)
+        {
+            int index = tx + (ty * diff->tilesX);
+            int tw = zbmp->w - (tx * Z_DIFF_TILE);
+            const Pixel *tile = &zbmp->pixels[(tx * Z_DIFF_TILE) + (ty * Z_DIFF_TILE * zbmp->w)];
+            unsigned int hash;
+#ifdef ZILEAN_X86
+            if((tw >= Z_DIFF_TILE) && (zGetKernelLevel() >= Z_KERNEL_AVX2))
+            {
+                hash = diffTileAVX2(tile, zbmp->w, th);
+            }
+            else if((tw >= Z_DIFF_TILE) && (zGetKernelLevel() >= Z_KERNEL_SSE2))
+            {
+                hash = diffTileSSE2(tile, zbmp->w, th);
+            }
+            else
+#endif
+            {
+                hash = diffTileScalar(tile, zbmp->w, (tw < Z_DIFF_TILE) ? tw : Z_DIFF_TILE, th);
+            }
+            if(changedCount >= 0)
+            {
+                diff->changed[index] = (hash != diff->hashes[index]);
+                changedCount += diff->changed[index];
+            }
+            diff->hashes[index] = hash;
+        }
+    }
+    diff->valid = 1;
+
+    ++diff->frames;
+    diff->hashMs += zTimeNow() - start;
+    zTraceEnd();
+    return changedCount;
+}
+
+int zFrameDiffCount(zFrameDiff *diff, RECT *box)
+{
+    int tx, ty;
+    int count = 0;
+    int left = (box->left > 0) ? box->left : 0;
+    int top = (box->top > 0) ? box->top : 0;
+    int right = (box->right < diff->w - 1) ? box->right : diff->w - 1;
+    int bottom = (box->bottom < diff->h - 1) ? box->bottom : diff->h - 1;
+    if(!diff->valid || (left > right) || (top > bottom))
+    {
+        return 0;
+    }
+    for(ty = top / Z_DIFF_TILE; ty <= bottom / Z_DIFF_TILE; ++ty)
+    {
+        for(tx = left / Z_DIFF_TILE; tx <= right / Z_DIFF_TILE; ++tx)
+        {
+            count += diff->changed[tx + (ty * diff->tilesX)];
+        }
+    }
+    return count;
+}
+
+// ------------------------------------------------------------------------------------------------
+// File lists
+//
+// Sorted collections of paths built from files, directories (searched recursively for *.png) and
+// list files, for the tools that chew through screenshot archives.
+
+void zFileListAdd(zFileList *list, const char *name)
+{
+    if(list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->names = realloc(list->names, list->capacity * sizeof(char *));
+    }
+    list->names[list->count] = malloc(strlen(name) + 1);
+    strcpy(list->names[list->count], name);
+    ++list->count;
+}
+
+void zFileListFree(zFileList *list)
+{
+    int i;
+    for(i = 0; i < list->count; ++i)
+    {
+        free(list->names[i]);
+    }
+    free(list->names);
+    memset(list, 0, sizeof(zFileList));
+}
+
+static int hasPngExtension(const char *name)
+{
+    size_t len = strlen(name);
+    const char *ext;
+    if(len < 4)
+    {
+        return 0;
+    }
+    ext = name + len - 4;
+    return (ext[0] == '.')
+        && ((ext[1] == 'p') || (ext[1] == 'P'))
+        && ((ext[2] == 'n') || (ext[2] == 'N'))
+        && ((ext[3] == 'g') || (ext[3] == 'G'));
+}
+
+// returns 0 if path isn't a directory (or can't be opened as one)
+static int fileListAddDirectory(zFileList *list, const char *path)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find;
+    char *pattern = malloc(strlen(path) + 3);
+    sprintf(pattern, "%s\\*", path);
+    find = FindFirstFileA(pattern, &data);
+    free(pattern);
+    if(find == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+    do
+    {
+        char *child;
+        if(!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, ".."))
+        {
+            continue;
+        }
+        child = malloc(strlen(path) + strlen(data.cFileName) + 2);
+        sprintf(child, "%s\\%s", path, data.cFileName);
+        if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            fileListAddDirectory(list, child);
+        }
+        else if(hasPngExtension(child))
+        {
+            zFileListAdd(list, child);
+        }
+        free(child);
+    } while(FindNextFileA(find, &data));
+    FindClose(find);
+    return 1;
+#else
+    struct dirent *entry;
+    DIR *dir = opendir(path);
+    if(!dir)
+    {
+        return 0;
+    }
+    while((entry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+        char *child;
+        if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+        {
+            continue;
+        }
+        child = malloc(strlen(path) + strlen(entry->d_name) + 2);
+        sprintf(child, "%s/%s", path, entry->d_name);
+        if(stat(child, &st) == 0)
+        {
+            if(S_ISDIR(st.st_mode))
+            {
+                fileListAddDirectory(list, child);
+            }
+            else if(hasPngExtension(child))
+            {
+                zFileListAdd(list, child);
+            }
+        }
+        free(child);
+    }
+    closedir(dir);
+    return 1;
+#endif
+}
+
+void zFileListAddPath(zFileList *list, const char *path)
+{
+    if(!fileListAddDirectory(list, path))
+    {
+        zFileListAdd(list, path);
+    }
+}
+
+int zFileListAddListFile(zFileList *list, const char *listFile)
+{
+    char line[4096];
+    FILE *f = strcmp(listFile, "-") ? fopen(listFile, "r") : stdin;
+    if(!f)
+    {
+        perror(listFile);
+        return 0;
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+        size_t len = strlen(line);
+        while((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+        {
+            line[--len] = 0;
+        }
+        if(len > 0)
+        {
+            zFileListAddPath(list, line);
+        }
+    }
+    if(f != stdin)
+    {
+        fclose(f);
+    }
+    return 1;
+}
+
+static int compareNames(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+void zFileListSort(zFileList *list)
+{
+    qsort(list->names, list->count, sizeof(char *), compareNames);
+}
+
+
+// ------------------------------------------------------------------------------------------------
+// Capture/analysis pipeline
+//
+// A capture thread fills frames and an analysis thread consumes them, so a slow analysis delays
+// neither the UI nor the next capture. Frames live in a zFrameRing of pre-allocated slots handed
+// between the two threads purely through per-slot state CAS: the producer takes a FREE slot, or
+// when there is none steals the oldest READY one (drop-oldest backpressure); the consumer takes
+// the oldest READY slot. With at least three slots the producer always finds one, since each side
+// holds at most one at a time. Results go back through a zResultMailbox, a triple buffer the UI
+// thread can poll without ever blocking the analysis thread.
+
+#define MAILBOX_FRESH 4
+
+zFrameRing * zFrameRingCreate(int count)
+{
+    zFrameRing *ring = calloc(1, sizeof(zFrameRing));
+    if(count < 3)
+    {
+        count = 3;
+    }
+    ring->slots = calloc(count, sizeof(zFrameSlot));
+    ring->count = count;
+    return ring;
+}
+
+void zFrameRingDestroy(zFrameRing *ring)
+{
+    int i;
+    for(i = 0; i < ring->count; ++i)
+    {
+        if(ring->slots[i].bitmap)
+        {
+            zBitmapDestroy(ring->slots[i].bitmap);
+        }
+    }
+    free(ring->slots);
+    free(ring);
+}
+
+// oldest slot in the given state, by commit order, and the sequence it had when looked at
+static zFrameSlot * frameRingOldest(zFrameRing *ring, long state, unsigned int *sequenceSeen)
+{
+    zFrameSlot *oldest = NULL;
+    unsigned int oldestSequence = 0;
+    int i;
+    for(i = 0; i < ring->count; ++i)
+    {
+        zFrameSlot *slot = &ring->slots[i];
+        unsigned int sequence;
+        if(zAtomicLoad(&slot->state) != state)
+        {
+            continue;
+        }
+        // the slot may be taken over right after this; the caller's CAS on state settles that
+        sequence = (unsigned int)zAtomicLoad(&slot->sequence);
+        if(!oldest || ((int)(sequence - oldestSequence) < 0))
+        {
+            oldest = slot;
+            oldestSequence = sequence;
+        }
+    }
+    *sequenceSeen = oldestSequence;
+    return oldest;
+}
+
+zFrameSlot * zFrameRingAcquireWrite(zFrameRing *ring)
+{
+    for(;;)
+    {
+        zFrameSlot *slot;
+        unsigned int sequence;
+        int i;
+        for(i = 0; i < ring->count; ++i)
+        {
+            if(zAtomicCas(&ring->slots[i].state, Z_FRAME_FREE, Z_FRAME_WRITING))
+            {
+                return &ring->slots[i];
+            }
+        }
+        // full: overwrite the oldest frame the consumer hasn't claimed (it may claim it first). Only
+        // this thread commits, so a READY slot can't come back with a newer frame behind its back.
+        slot = frameRingOldest(ring, Z_FRAME_READY, &sequence);
+        if(slot && zAtomicCas(&slot->state, Z_FRAME_READY, Z_FRAME_WRITING))
+        {
+            zAtomicIncrement(&ring->dropped);
+            return slot;
+        }
+    }
+}
+
+// only while the slot is held for writing; pixels are undefined afterwards
+void zFrameSlotResize(zFrameSlot *slot, int w, int h)
+{
+    if(slot->bitmap && (slot->bitmap->w == w) && (slot->bitmap->h == h))
+    {
+        return;
+    }
+    if(slot->bitmap)
+    {
+        zBitmapDestroy(slot->bitmap);
+    }
+    slot->bitmap = zBitmapCreate(w, h);
+}
+
+void zFrameSlotPrepare(zFrameSlot *slot, int frameW, int frameH)
+{
+    RECT *request = &slot->request;
+    if((slot->requestW == frameW) && (slot->requestH == frameH)
+    && (request->left >= 0) && (request->top >= 0)
+    && (request->left < request->right) && (request->top < request->bottom)
+    && (request->right <= frameW) && (request->bottom <= frameH))
+    {
+        memcpy(&slot->region, request, sizeof(RECT));
+    }
+    else
+    {
+        slot->region.left = 0;
+        slot->region.top = 0;
+        slot->region.right = frameW;
+        slot->region.bottom = frameH;
+    }
+    slot->frameW = frameW;
+    slot->frameH = frameH;
+    zFrameSlotResize(slot, slot->region.right - slot->region.left, slot->region.bottom - slot->region.top);
+}
+
+void zFrameSlotCopyRegion(zFrameSlot *slot, const Pixel *frame, int stride)
+{
+    int w = slot->region.right - slot->region.left;
+    const Pixel *src = frame + slot->region.left + (slot->region.top * stride);
+    int j;
+    for(j = 0; j < slot->bitmap->h; ++j)
+    {
+        memcpy(&slot->bitmap->pixels[j * w], src + (j * stride), w * sizeof(Pixel));
+    }
+}
+
+void zFrameRingCommit(zFrameRing *ring, zFrameSlot *slot)
+{
+    zAtomicExchange(&slot->sequence, ring->nextSequence++);
+    slot->captureTime = zTimeNow();
+    zAtomicIncrement(&ring->committed);
+    zAtomicExchange(&slot->state, Z_FRAME_READY);
+}
+
+void zFrameRingAbandon(zFrameRing *ring, zFrameSlot *slot)
+{
+    (void)ring;
+    zAtomicExchange(&slot->state, Z_FRAME_FREE);
+}
+
+// returns NULL when no frame is waiting
+zFrameSlot * zFrameRingAcquireRead(zFrameRing *ring)
+{
+    for(;;)
+    {
+        unsigned int sequence;
+        zFrameSlot *slot = frameRingOldest(ring, Z_FRAME_READY, &sequence);
+        if(!slot)
+        {
+            return NULL;
+        }
+        if(zAtomicCas(&slot->state, Z_FRAME_READY, Z_FRAME_READING))
+        {
+            // The scan isn't atomic: between it and the CAS the producer may have dropped this
+            // frame and committed a newer one to the same slot, and a slot passed over while still
+            // being written may have committed a frame older than this one. Either way an older
+            // frame is waiting, so hand this one back and look again. Anything committed from
+            // here on is newer.
+            unsigned int olderSequence;
+            zFrameSlot *older;
+            if(zAtomicLoad(&slot->sequence) == sequence)
+            {
+                older = frameRingOldest(ring, Z_FRAME_READY, &olderSequence);
+                if(!older || ((int)(olderSequence - sequence) > 0))
+                {
+                    return slot;
+                }
+            }
+            zAtomicExchange(&slot->state, Z_FRAME_READY);
+        }
+    }
+}
+
+void zFrameRingRelease(zFrameRing *ring, zFrameSlot *slot)
+{
+    zAtomicIncrement(&ring->consumed);
+    zAtomicExchange(&slot->state, Z_FRAME_FREE);
+}
+
+void zResultMailboxInit(zResultMailbox *mailbox)
+{
+    memset(mailbox, 0, sizeof(zResultMailbox));
+    mailbox->back = 0;
+    mailbox->middle = 1;
+    mailbox->front = 2;
+}
+
+static unsigned long long allRowsMask(int rowCount)
+{
+    return (rowCount >= 64) ? ~0ULL : ((1ULL << rowCount) - 1);
+}
+
+// The changes go into pending before the result is swapped in, so whichever take first sees the
+// result (or a newer one) also sees them
+void zResultMailboxPublish(zResultMailbox *mailbox, zFrameResult *result)
+{
+    zAtomicOr(&mailbox->pendingRows[0], (long)(result->changedRows & 0xffffffffu));
+    zAtomicOr(&mailbox->pendingRows[1], (long)(result->changedRows >> 32));
+    if(result->analysis == Z_ANALYSIS_FULL)
+    {
+        zAtomicOr(&mailbox->pendingFull, 1);
+    }
+    memcpy(&mailbox->buffers[mailbox->back], result, sizeof(zFrameResult));
+    mailbox->back = (int)(zAtomicExchange(&mailbox->middle, mailbox->back | MAILBOX_FRESH) & 3);
+}
+
+// returns 1 and the newest result if one was published since the last take
+int zResultMailboxTake(zResultMailbox *mailbox, zFrameResult *result)
+{
+    unsigned long long low, high;
+    if(!(zAtomicLoad(&mailbox->middle) & MAILBOX_FRESH))
+    {
+        return 0;
+    }
+    mailbox->front = (int)(zAtomicExchange(&mailbox->middle, mailbox->front) & 3);
+    memcpy(result, &mailbox->buffers[mailbox->front], sizeof(zFrameResult));
+
+    low = (unsigned long)zAtomicExchange(&mailbox->pendingRows[0], 0) & 0xffffffffu;
+    high = (unsigned long)zAtomicExchange(&mailbox->pendingRows[1], 0) & 0xffffffffu;
+    result->changedRows |= low | (high << 32);
+    if(zAtomicExchange(&mailbox->pendingFull, 0))
+    {
+        result->analysis = Z_ANALYSIS_FULL;
+        result->changedRows = allRowsMask(result->info.rowCount);
+    }
+    else if((result->analysis == Z_ANALYSIS_SKIPPED) && result->changedRows)
+    {
+        result->analysis = Z_ANALYSIS_ROWS;
+    }
+    return 1;
+}
+
+void zRoiInit(zRoi *roi)
+{
+    memset(roi, 0, sizeof(zRoi));
+    zMutexInit(&roi->lock);
+}
+
+void zRoiDestroy(zRoi *roi)
+{
+    zMutexDestroy(&roi->lock);
+}
+
+void zRoiSetMargin(zRoi *roi, int margin)
+{
+    zMutexLock(&roi->lock);
+    roi->enabled = (margin >= 0);
+    roi->margin = margin;
+    memset(&roi->rect, 0, sizeof(RECT));
+    zMutexUnlock(&roi->lock);
+}
+
+void zRoiRequest(zRoi *roi, zFrameSlot *slot)
+{
+    zMutexLock(&roi->lock);
+    if(roi->enabled && (roi->rect.left < roi->rect.right))
+    {
+        memcpy(&slot->request, &roi->rect, sizeof(RECT));
+        slot->requestW = roi->frameW;
+        slot->requestH = roi->frameH;
+    }
+    else
+    {
+        memset(&slot->request, 0, sizeof(RECT));
+        slot->requestW = 0;
+        slot->requestH = 0;
+    }
+    zMutexUnlock(&roi->lock);
+}
+
+int zRoiUpdate(zRoi *roi, zFrameSlot *slot, zScoreboardInfo *info)
+{
+    RECT *box = &info->scoreBox;
+    RECT *region = &slot->region;
+    int partial = (region->left > 0) || (region->top > 0) || (region->right < slot->frameW) || (region->bottom < slot->frameH);
+    int found = (box->left < box->right) && (box->top < box->bottom) && (info->rowCount > 0);
+    int trusted = 1;
+
+    zMutexLock(&roi->lock);
+    if(partial)
+    {
+        // A box running into the region's border may well continue past it, and one that moved
+        // further than the margin is more likely a piece of something else than the scoreboard
+        found = found && (box->left > region->left) && (box->top > region->top)
+                      && (box->right < region->right - 1) && (box->bottom < region->bottom - 1)
+                      && closeEnough(box->left, roi->box.left, roi->margin)
+                      && closeEnough(box->top, roi->box.top, roi->margin)
+                      && closeEnough(box->right, roi->box.right, roi->margin)
+                      && closeEnough(box->bottom, roi->box.bottom, roi->margin);
+        zAtomicIncrement(&roi->regionFrames);
+    }
+    else
+    {
+        zAtomicIncrement(&roi->fullFrames);
+    }
+
+    if(roi->enabled && found)
+    {
+        memcpy(&roi->box, box, sizeof(RECT));
+        roi->frameW = slot->frameW;
+        roi->frameH = slot->frameH;
+        roi->rect.left = (box->left - roi->margin > 0) ? (box->left - roi->margin) : 0;
+        roi->rect.top = (box->top - roi->margin > 0) ? (box->top - roi->margin) : 0;
+        roi->rect.right = (box->right + roi->margin + 1 < slot->frameW) ? (box->right + roi->margin + 1) : slot->frameW;
+        roi->rect.bottom = (box->bottom + roi->margin + 1 < slot->frameH) ? (box->bottom + roi->margin + 1) : slot->frameH;
+    }
+    else
+    {
+        memset(&roi->rect, 0, sizeof(RECT));
+    }
+    zMutexUnlock(&roi->lock);
+
+    if(partial && !found)
+    {
+        zAtomicIncrement(&roi->fallbacks);
+        trusted = 0;
+    }
+    return trusted;
+}
+
+static void rectOffset(RECT *r, int dx, int dy)
+{
+    r->left += dx;
+    r->top += dy;
+    r->right += dx;
+    r->bottom += dy;
+}
+
+// findScoreboard on a region works in region coordinates; results are reported in frame coordinates
+static void infoOffset(zScoreboardInfo *info, int dx, int dy)
+{
+    int k;
+    rectOffset(&info->scoreBox, dx, dy);
+    rectOffset(&info->facesBox, dx, dy);
+    for(k = 0; k < info->rowCount; ++k)
+    {
+        info->rows[k].top += dy;
+        info->rows[k].bottom += dy;
+    }
+}
+
+static void pipelineCaptureThread(void *arg)
+{
+    zPipeline *pipeline = (zPipeline *)arg;
+    while(!zAtomicLoad(&pipeline->quit))
+    {
+        double start = zTimeNow();
+        double wait = pipeline->intervalMs;
+        zFrameSlot *slot = zFrameRingAcquireWrite(pipeline->ring);
+        zTraceBegin("capture");
+        zRoiRequest(&pipeline->roi, slot);
+        slot->frameW = 0;
+        if(pipeline->capture(pipeline->captureContext, slot))
+        {
+            if(slot->frameW == 0)
+            {
+                // the capture didn't deal in regions: it's the whole frame
+                slot->frameW = slot->bitmap->w;
+                slot->frameH = slot->bitmap->h;
+                slot->region.left = 0;
+                slot->region.top = 0;
+                slot->region.right = slot->frameW;
+                slot->region.bottom = slot->frameH;
+            }
+            zFrameRingCommit(pipeline->ring, slot);
+            if(zAtomicLoad(&pipeline->analysisSleeping))
+            {
+                zMutexLock(&pipeline->wakeLock);
+                zCondSignal(&pipeline->wake);
+                zMutexUnlock(&pipeline->wakeLock);
+            }
+        }
+        else
+        {
+            zFrameRingAbandon(pipeline->ring, slot);
+            if(wait < 1.0)
+            {
+                wait = 1.0; // nothing to capture; don't spin
+            }
+        }
+        zTraceEnd();
+        zSleepMs(wait - (zTimeNow() - start));
+    }
+}
+
+// Hashes the frame's tiles and decides whether the last result still holds: if nothing in the
+// scorebox changed the frame is skipped, and if the box edges and the faces column didn't change
+// the boxes and row spans can't have moved, so only the rows with changed tiles are reported.
+// Returns 0 when the frame needs a full findScoreboard.
+static int pipelineReuseLast(zPipeline *pipeline, zFrameSlot *slot, zFrameResult *result)
+{
+    zFrameDiff *diff = pipeline->diff;
+    zScoreboardInfo lastInfo;
+    zScoreboardInfo *last = &lastInfo;
+    RECT edges[EDGE_COUNT];
+    double hashed = diff->hashMs;
+    int changed;
+    int edge, k;
+
+    // tiles only compare between frames captured from the same region
+    if(!pipeline->haveLast || memcmp(&pipeline->last.region, &slot->region, sizeof(RECT)))
+    {
+        diff->valid = 0;
+    }
+    changed = zFrameDiffUpdate(diff, slot->bitmap);
+    result->hashMs = diff->hashMs - hashed;
+    if(!pipeline->haveLast || (changed < 0))
+    {
+        return 0;
+    }
+
+    // the tile map is in bitmap coordinates
+    memcpy(last, &pipeline->last.info, sizeof(zScoreboardInfo));
+    infoOffset(last, -slot->region.left, -slot->region.top);
+    if((last->rowCount == 0) || (last->scoreBox.left >= last->scoreBox.right) || (last->scoreBox.top >= last->scoreBox.bottom))
+    {
+        // no scoreboard last time (a loading screen can still leave a degenerate box behind):
+        // only an identical frame can't have one now
+        if(changed > 0)
+        {
+            return 0;
+        }
+        result->analysis = Z_ANALYSIS_SKIPPED;
+    }
+    else if(zFrameDiffCount(diff, &last->scoreBox) == 0)
+    {
+        result->analysis = Z_ANALYSIS_SKIPPED;
+    }
+    else
+    {
+        for(edge = 0; edge < EDGE_COUNT; ++edge)
+        {
+            memcpy(&edges[edge], &last->scoreBox, sizeof(RECT));
+        }
+        edges[EDGE_LEFT].right = last->scoreBox.left;
+        edges[EDGE_TOP].bottom = last->scoreBox.top;
+        edges[EDGE_RIGHT].left = last->scoreBox.right;
+        edges[EDGE_BOTTOM].top = last->scoreBox.bottom;
+        for(edge = 0; edge < EDGE_COUNT; ++edge)
+        {
+            if(zFrameDiffCount(diff, &edges[edge]) > 0)
+            {
+                return 0;
+            }
+        }
+        if(zFrameDiffCount(diff, &last->facesBox) > 0)
+        {
+            return 0;
+        }
+        result->analysis = Z_ANALYSIS_ROWS;
+    }
+
+    memcpy(&result->info, &pipeline->last.info, sizeof(zScoreboardInfo));
+    memset(result->info.stageMs, 0, sizeof(result->info.stageMs));
+    memset(result->info.stageCounters, 0, sizeof(result->info.stageCounters));
+    result->changedRows = 0;
+    if(result->analysis == Z_ANALYSIS_ROWS)
+    {
+        for(k = 0; k < last->rowCount; ++k)
+        {
+            RECT row;
+            row.left = last->scoreBox.left;
+            row.right = last->scoreBox.right;
+            row.top = last->rows[k].top;
+            row.bottom = last->rows[k].bottom - 1; // spans end at the first non-gray line
+            if(zFrameDiffCount(diff, &row) > 0)
+            {
+                result->changedRows |= 1ULL << k;
+            }
+        }
+        ++diff->rowsOnly;
+    }
+    else
+    {
+        ++diff->skipped;
+    }
+    return 1;
+}
+
+static void pipelineAnalysisThread(void *arg)
+{
+    zPipeline *pipeline = (zPipeline *)arg;
+    for(;;)
+    {
+        zFrameResult result;
+        int trusted;
+        zFrameSlot *slot = zFrameRingAcquireRead(pipeline->ring);
+        if(!slot)
+        {
+            // only an idle consumer touches the lock; the producer signals just when it's asleep
+            zMutexLock(&pipeline->wakeLock);
+            zAtomicExchange(&pipeline->analysisSleeping, 1);
+            slot = zFrameRingAcquireRead(pipeline->ring);
+            while(!slot && !zAtomicLoad(&pipeline->quit))
+            {
+                zCondWait(&pipeline->wake, &pipeline->wakeLock);
+                slot = zFrameRingAcquireRead(pipeline->ring);
+            }
+            zAtomicExchange(&pipeline->analysisSleeping, 0);
+            zMutexUnlock(&pipeline->wakeLock);
+            if(!slot)
+            {
+                return;
+            }
+        }
+
+        zTraceBegin("analyze frame");
+        result.hashMs = 0.0;
+        trusted = 1;
+        if(!pipeline->diff || !pipelineReuseLast(pipeline, slot, &result))
+        {
+            findScoreboard(slot->bitmap, &pipeline->tracker, pipeline->cache, &result.info);
+            infoOffset(&result.info, slot->region.left, slot->region.top);
+            result.analysis = Z_ANALYSIS_FULL;
+            result.changedRows = allRowsMask(result.info.rowCount);
+            trusted = zRoiUpdate(&pipeline->roi, slot, &result.info);
+        }
+        memcpy(&result.region, &slot->region, sizeof(RECT));
+        result.sequence = slot->sequence;
+        result.captureTime = slot->captureTime;
+        result.analyzedTime = zTimeNow();
+        zFrameRingRelease(pipeline->ring, slot);
+        ++pipeline->analyzed;
+        // a region that lost the scoreboard says nothing about the frame; the next one will be full
+        pipeline->haveLast = trusted;
+        if(trusted)
+        {
+            memcpy(&pipeline->last, &result, sizeof(zFrameResult));
+            zResultMailboxPublish(&pipeline->results, &result);
+        }
+        zTraceEnd();
+    }
+}
+
+// Starts both threads. cache and diff may be NULL and must not be used elsewhere while the pipeline
+// runs; with a diff, frames whose scorebox didn't change skip analysis (see zFrameResult.analysis).
+zPipeline * zPipelineCreate(int ringSize, double intervalMs, zCaptureFunc capture, void *captureContext, zLayoutCache *cache, zFrameDiff *diff)
+{
+    zPipeline *pipeline = calloc(1, sizeof(zPipeline));
+    pipeline->ring = zFrameRingCreate(ringSize);
+    zResultMailboxInit(&pipeline->results);
+    pipeline->capture = capture;
+    pipeline->captureContext = captureContext;
+    pipeline->intervalMs = intervalMs;
+    pipeline->cache = cache;
+    pipeline->diff = diff;
+    zRoiInit(&pipeline->roi);
+    zTrackerInit(&pipeline->tracker);
+    zMutexInit(&pipeline->wakeLock);
+    zCondInit(&pipeline->wake);
+    zScoreboardInit();
+    zThreadCreate(&pipeline->analysisThread, pipelineAnalysisThread, pipeline);
+    zThreadCreate(&pipeline->captureThread, pipelineCaptureThread, pipeline);
+    return pipeline;
+}
+
+void zPipelineStop(zPipeline *pipeline)
+{
+    if(pipeline->stopped)
+    {
+        return;
+    }
+    zAtomicExchange(&pipeline->quit, 1);
+    zThreadJoin(pipeline->captureThread);
+    zMutexLock(&pipeline->wakeLock);
+    zCondSignal(&pipeline->wake);
+    zMutexUnlock(&pipeline->wakeLock);
+    zThreadJoin(pipeline->analysisThread);
+    pipeline->stopped = 1;
+}
+
+void zPipelineDestroy(zPipeline *pipeline)
+{
+    zPipelineStop(pipeline);
+    zCondDestroy(&pipeline->wake);
+    zMutexDestroy(&pipeline->wakeLock);
+    zRoiDestroy(&pipeline->roi);
+    zFrameRingDestroy(pipeline->ring);
+    free(pipeline);
+}
+
+// For the UI thread: never blocks, returns 1 with the newest result when there's one it hasn't seen
+int zPipelineLatest(zPipeline *pipeline, zFrameResult *result)
+{
+    return zResultMailboxTake(&pipeline->results, result);
+}
+
+void zPipelineSetRoiMargin(zPipeline *pipeline, int margin)
+{
+    zRoiSetMargin(&pipeline->roi, margin);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Frame sources
+//
+// The GDI capture lives with the UI in zilean.c; the backends here exist so the pipeline can be
+// driven headless, from screenshots, recordings or generated frames, at whatever rate and
+// resolution a load test wants.
+
+int zFrameSourceCapture(void *context, zFrameSlot *slot)
+{
+    zFrameSource *source = (zFrameSource *)context;
+    return source->read(source, slot);
+}
+
+double zFrameSourceInterval(zFrameSource *source)
+{
+    return (source->fps > 0.0) ? (1000.0 / source->fps) : 0.0;
+}
+
+void zFrameSourceDestroy(zFrameSource *source)
+{
+    source->destroy(source);
+}
+
+// PNGs: decoded on the capture thread, like a real capture would convert. Decoded bitmaps come
+// from a pool and are copied into the slot, so steady-state playback doesn't allocate.
+
+typedef struct PngSource
+{
+    zFrameSource base;
+    zFileList files;
+    zBitmapPool *pool;
+    int next;
+} PngSource;
+
+static int pngSourceRead(zFrameSource *source, zFrameSlot *slot)
+{
+    PngSource *png = (PngSource *)source;
+    zBitmap *zbmp;
+    if(png->files.count == 0)
+    {
+        return 0;
+    }
+    // a file that fails to decode is skipped, not retried
+    zbmp = loadScoreboardPooled(png->files.names[png->next], png->pool);
+    png->next = (png->next + 1) % png->files.count;
+    if(!zbmp)
+    {
+        return 0;
+    }
+    // copied rather than swapped in: slot bitmaps belong to the ring, and only what the pool handed
+    // out may go back to it
+    zFrameSlotPrepare(slot, zbmp->w, zbmp->h);
+    zFrameSlotCopyRegion(slot, zbmp->pixels, zbmp->w);
+    zBitmapPoolRelease(png->pool, zbmp);
+    ++source->frames;
+    return 1;
+}
+
+static void pngSourceDestroy(zFrameSource *source)
+{
+    PngSource *png = (PngSource *)source;
+    zFileListFree(&png->files);
+    zBitmapPoolDestroy(png->pool);
+    free(png);
+}
+
+zFrameSource * zFrameSourceCreatePngs(zFileList *files, double fps)
+{
+    PngSource *png = calloc(1, sizeof(PngSource));
+    int i;
+    for(i = 0; i < files->count; ++i)
+    {
+        zFileListAdd(&png->files, files->names[i]);
+    }
+    png->pool = zBitmapPoolCreate(2);
+    png->base.name = "png";
+    png->base.read = pngSourceRead;
+    png->base.destroy = pngSourceDestroy;
+    png->base.fps = fps;
+    png->base.frameCount = files->count;
+    return &png->base;
+}
+
+// Raw recordings: mapped read-only and copied out a frame at a time, so playback speed is bounded
+// by memcpy (and the page cache) rather than by a decoder.
+
+typedef struct RawSource
+{
+    zFrameSource base;
+    const unsigned char *data;
+    size_t size;
+} RawSource;
+
+static int rawSourceRead(zFrameSource *source, zFrameSlot *slot)
+{
+    RawSource *raw = (RawSource *)source;
+    size_t frameBytes = (size_t)source->w * source->h * sizeof(Pixel);
+    zFrameSlotPrepare(slot, source->w, source->h);
+    zFrameSlotCopyRegion(slot, (const Pixel *)(raw->data + (source->frames % source->frameCount) * frameBytes), source->w);
+    ++source->frames;
+    return 1;
+}
+
+static void rawSourceDestroy(zFrameSource *source)
+{
+    RawSource *raw = (RawSource *)source;
+#ifdef _WIN32
+    UnmapViewOfFile(raw->data);
+#else
+    munmap((void *)raw->data, raw->size);
+#endif
+    free(raw);
+}
+
+zFrameSource * zFrameSourceCreateRaw(const char *filename, int w, int h, double fps)
+{
+    RawSource *raw;
+    const unsigned char *data = NULL;
+    size_t size = 0;
+    size_t frameBytes = (size_t)w * h * sizeof(Pixel);
+#ifdef _WIN32
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = NULL;
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "error: can't open %s\n", filename);
+        return NULL;
+    }
+    if(GetFileSizeEx(file, &fileSize) && (fileSize.QuadPart > 0))
+    {
+        size = (size_t)fileSize.QuadPart;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if(mapping)
+    {
+        data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+#else
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+    {
+        perror(filename);
+        return NULL;
+    }
+    if((fstat(fd, &st) == 0) && (st.st_size > 0))
+    {
+        size = (size_t)st.st_size;
+        data = (const unsigned char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if(data == (const unsigned char *)MAP_FAILED)
+        {
+            data = NULL;
+        }
+        else
+        {
+            madvise((void *)data, size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+#endif
+    if(!data)
+    {
+        fprintf(stderr, "error: can't map %s\n", filename);
+        return NULL;
+    }
+    if((w <= 0) || (h <= 0) || (size < frameBytes))
+    {
+        fprintf(stderr, "error: %s doesn't hold a single %dx%d frame\n", filename, w, h);
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap((void *)data, size);
+#endif
+        return NULL;
+    }
+
+    raw = calloc(1, sizeof(RawSource));
+    raw->data = data;
+    raw->size = size;
+    raw->base.name = "raw";
+    raw->base.read = rawSourceRead;
+    raw->base.destroy = rawSourceDestroy;
+    raw->base.fps = fps;
+    raw->base.w = w;
+    raw->base.h = h;
+    raw->base.frameCount = (long)(size / frameBytes);
+    return &raw->base;
+}
+
+// Synthetic scoreboards: the same frame every time except for the game timer, which is what a
+// scoreboard held open mostly looks like.
+
+zBitmap * zSyntheticScoreboardCreate(int w, int h)
+{
+    zBitmap *zbmp = zBitmapCreate(w, h);
+    unsigned int seed = 0x12345678u ^ (unsigned int)(w * 31 + h);
+    RECT board;
+    RECT faces;
+    int i, j;
+
+    for(i = 0; i < w * h; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        pixelSet(&zbmp->pixels[i], (unsigned char)(seed >> 24), (unsigned char)(seed >> 16), (unsigned char)(seed >> 8), 255);
+    }
+
+    board.left = w / 8;
+    board.top = h / 6;
+    board.right = w - (w / 8);
+    board.bottom = h - (h / 6);
+    zBitmapBox(zbmp, &board, 33, 69, 61);
+    inflateRect(&board, -1, w, h);
+    zBitmapBox(zbmp, &board, 33, 69, 61);
+
+    faces.left = board.left + (board.right - board.left) / 20;
+    faces.right = faces.left + (board.right - board.left) / 40;
+    for(j = board.top + 40; j + 24 < board.bottom - 20; j += 40)
+    {
+        faces.top = j;
+        faces.bottom = j + 24;
+        zBitmapFill(zbmp, &faces, 40, 40, 40);
+    }
+    return zbmp;
+}
+
+// mm:ss as four cells just inside the board's top right corner, each a light gray keyed to its digit
+void zSyntheticScoreboardDrawTimer(zBitmap *zbmp, int frameW, int frameH, int originX, int originY, int seconds)
+{
+    int digits[4];
+    int cellW = (frameW / 80 > 2) ? (frameW / 80) : 2;
+    int cellH = (frameH / 60 > 4) ? (frameH / 60) : 4;
+    RECT cell;
+    int k;
+
+    digits[0] = (seconds / 600) % 10;
+    digits[1] = (seconds / 60) % 10;
+    digits[2] = (seconds % 60) / 10;
+    digits[3] = seconds % 10;
+    for(k = 0; k < 4; ++k)
+    {
+        int level = 100 + (digits[k] * 15);
+        cell.left = frameW - (frameW / 8) - 8 - ((4 - k) * (cellW + 2)) - originX;
+        cell.right = cell.left + cellW;
+        cell.top = (frameH / 6) + 8 - originY;
+        cell.bottom = cell.top + cellH;
+        // clipped to the part of the frame zbmp holds
+        cell.left = (cell.left > 0) ? cell.left : 0;
+        cell.top = (cell.top > 0) ? cell.top : 0;
+        cell.right = (cell.right < zbmp->w) ? cell.right : zbmp->w;
+        cell.bottom = (cell.bottom < zbmp->h) ? cell.bottom : zbmp->h;
+        if((cell.left < cell.right) && (cell.top < cell.bottom))
+        {
+            zBitmapFill(zbmp, &cell, level, level, level);
+        }
+    }
+}
+
+typedef struct SyntheticSource
+{
+    zFrameSource base;
+    zBitmap *frame;
+} SyntheticSource;
+
+static int syntheticSourceRead(zFrameSource *source, zFrameSlot *slot)
+{
+    SyntheticSource *synthetic = (SyntheticSource *)source;
+    double fps = (source->fps > 0.0) ? source->fps : 30.0;
+    zFrameSlotPrepare(slot, source->w, source->h);
+    zFrameSlotCopyRegion(slot, synthetic->frame->pixels, source->w);
+    zSyntheticScoreboardDrawTimer(slot->bitmap, source->w, source->h, slot->region.left, slot->region.top, (int)(source->frames / fps));
+    ++source->frames;
+    return 1;
+}
+
+static void syntheticSourceDestroy(zFrameSource *source)
+{
+    SyntheticSource *synthetic = (SyntheticSource *)source;
+    zBitmapDestroy(synthetic->frame);
+    free(synthetic);
+}
+
+zFrameSource * zFrameSourceCreateSynthetic(int w, int h, double fps)
+{
+    SyntheticSource *synthetic = calloc(1, sizeof(SyntheticSource));
+    synthetic->frame = zSyntheticScoreboardCreate(w, h);
+    synthetic->base.name = "synthetic";
+    synthetic->base.read = syntheticSourceRead;
+    synthetic->base.destroy = syntheticSourceDestroy;
+    synthetic->base.fps = fps;
+    synthetic->base.w = w;
+    synthetic->base.h = h;
+    return &synthetic->base;
+}
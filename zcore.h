@@ -0,0 +1,729 @@
+#ifndef ZCORE_H
+#define ZCORE_H
+
+// Portable scoreboard analysis: bitmaps, box search, champion rows. Everything here builds without
+// windows.h so the same code can run headless (see zbatch.c); zilean.c adds the Win32 capture and UI.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+
+typedef struct tagRECT
+{
+    int left;
+    int top;
+    int right;
+    int bottom;
+} RECT;
+#endif
+
+#include <stddef.h>
+
+typedef struct Pixel
+{
+    unsigned char b;
+    unsigned char g;
+    unsigned char r;
+    unsigned char a;
+} Pixel;
+
+void pixelSet(Pixel *pixel, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+int pixelMatches(Pixel *pixel, unsigned char r, unsigned char g, unsigned char b, unsigned char tolerance);
+void inflateRect(RECT *r, int i, int w, int h);
+int closeEnough(int a, int b, int epsilon);
+
+// ------------------------------------------------------------------------------------------------
+// Logging and timing
+
+// Detection progress (box locations, champion rows) goes to stdout unless this is turned off
+void zSetVerbose(int verbose);
+// Milliseconds from an arbitrary fixed point
+double zTimeNow(void);
+
+// ------------------------------------------------------------------------------------------------
+// Tracing
+//
+// zTraceBegin/zTraceEnd bracket a named zone (name must be a string literal or otherwise outlive
+// the trace). Zones nest, and each thread records into its own ring buffer, so nothing is shared
+// on the hot path. They compile to nothing unless ZILEAN_TRACE is defined, and record nothing until
+// zTraceSetEnabled(1). Place them after a block's declarations; they expand to an empty statement.
+
+#ifdef ZILEAN_TRACE
+#define zTraceBegin(name)   zTraceBeginZone(name)
+#define zTraceEnd()         zTraceEndZone()
+#else
+#define zTraceBegin(name)
+#define zTraceEnd()
+#endif
+
+void zTraceBeginZone(const char *name);
+void zTraceEndZone(void);
+void zTraceSetEnabled(int enabled);
+// Writes every thread's recorded zones as Chrome/Perfetto trace JSON. Call it while the traced
+// threads are idle; returns 0 on failure or when built without ZILEAN_TRACE.
+int zTraceDump(const char *filename);
+
+// ------------------------------------------------------------------------------------------------
+// Threads and worker pool
+
+#ifdef _WIN32
+typedef HANDLE zThread;
+typedef CRITICAL_SECTION zMutex;
+typedef CONDITION_VARIABLE zCond;
+#define zMutexInit(m)       InitializeCriticalSection(m)
+#define zMutexDestroy(m)    DeleteCriticalSection(m)
+#define zMutexLock(m)       EnterCriticalSection(m)
+#define zMutexUnlock(m)     LeaveCriticalSection(m)
+#define zCondInit(c)        InitializeConditionVariable(c)
+#define zCondDestroy(c)
+#define zCondWait(c, m)     SleepConditionVariableCS(c, m, INFINITE)
+#define zCondSignal(c)      WakeConditionVariable(c)
+#define zCondBroadcast(c)   WakeAllConditionVariable(c)
+#define zAtomicIncrement(p) InterlockedIncrement((volatile LONG *)(p))
+#define zAtomicLoad(p)      InterlockedOr((volatile LONG *)(p), 0)
+#define zAtomicExchange(p, v) InterlockedExchange((volatile LONG *)(p), (v))
+#define zAtomicOr(p, v)     InterlockedOr((volatile LONG *)(p), (v))
+#define zAtomicCas(p, expected, desired) (InterlockedCompareExchange((volatile LONG *)(p), (desired), (expected)) == (expected))
+#define zAtomicCasPointer(p, expected, desired) (InterlockedCompareExchangePointer((PVOID volatile *)(p), (desired), (expected)) == (expected))
+#define zAtomicLoadPointer(p) InterlockedCompareExchangePointer((PVOID volatile *)(p), NULL, NULL)
+#else
+typedef pthread_t zThread;
+typedef pthread_mutex_t zMutex;
+typedef pthread_cond_t zCond;
+#define zMutexInit(m)       pthread_mutex_init(m, NULL)
+#define zMutexDestroy(m)    pthread_mutex_destroy(m)
+#define zMutexLock(m)       pthread_mutex_lock(m)
+#define zMutexUnlock(m)     pthread_mutex_unlock(m)
+#define zCondInit(c)        pthread_cond_init(c, NULL)
+#define zCondDestroy(c)     pthread_cond_destroy(c)
+#define zCondWait(c, m)     pthread_cond_wait(c, m)
+#define zCondSignal(c)      pthread_cond_signal(c)
+#define zCondBroadcast(c)   pthread_cond_broadcast(c)
+#define zAtomicIncrement(p) __sync_add_and_fetch((p), 1)
+#define zAtomicLoad(p)      __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define zAtomicExchange(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define zAtomicOr(p, v)     __sync_fetch_and_or((p), (v))
+#define zAtomicCas(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#define zAtomicCasPointer(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#define zAtomicLoadPointer(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#endif
+
+typedef void (*zThreadFunc)(void *arg);
+
+typedef void (*zWorkFunc)(void *context, int index);
+
+typedef struct zWorkerPool
+{
+    int threadCount; // including the thread calling zWorkerPoolRun
+    zThread *threads;
+    zMutex lock;
+    zCond wake;
+    zCond done;
+    zWorkFunc func;
+    void *context;
+    int nextIndex;
+    int count;
+    int pending;
+    int quit;
+} zWorkerPool;
+
+int zThreadCreate(zThread *thread, zThreadFunc func, void *arg);
+void zThreadJoin(zThread thread);
+int zCpuCount(void);
+void zSleepMs(double ms);
+zWorkerPool * zWorkerPoolCreate(int threadCount);
+void zWorkerPoolDestroy(zWorkerPool *pool);
+void zWorkerPoolRun(zWorkerPool *pool, zWorkFunc func, void *context, int count);
+
+// ------------------------------------------------------------------------------------------------
+// Bitmaps, pools and views
+
+typedef struct zBitmap
+{
+    int w;
+    int h;
+    Pixel *pixels;
+} zBitmap;
+
+typedef struct zBitmapPool
+{
+    zMutex lock;
+    zBitmap **free;
+    int freeCount;
+    int maxFree;            // idle bitmaps kept; beyond that releases are destroyed
+
+    int hits;               // acquires served from the free list
+    int misses;             // acquires that had to allocate
+    int outstanding;        // bitmaps currently handed out
+    size_t bytesResident;   // pixel bytes owned by the pool, idle or handed out
+} zBitmapPool;
+
+typedef struct zBitmapView
+{
+    Pixel *pixels;
+    int w;
+    int h;
+    int stride;
+} zBitmapView;
+
+#define zViewRow(view, j) ((view)->pixels + ((j) * (view)->stride))
+
+zBitmap * zBitmapCreate(int w, int h);
+void zBitmapDestroy(zBitmap * bmp);
+zBitmapPool * zBitmapPoolCreate(int maxFree);
+void zBitmapPoolDestroy(zBitmapPool *pool);
+zBitmap * zBitmapPoolAcquire(zBitmapPool *pool, int w, int h);
+void zBitmapPoolRelease(zBitmapPool *pool, zBitmap *bmp);
+void zBitmapPoolPrintStats(zBitmapPool *pool);
+void zViewCrop(zBitmapView *view, RECT *rect, zBitmapView *cropped);
+void zBitmapGetView(zBitmap *zbmp, RECT *rect, zBitmapView *view);
+void zViewBox(zBitmapView *view, RECT *rect, int r, int g, int b);
+void zViewFill(zBitmapView *view, RECT *rect, int r, int g, int b);
+void zViewGrayscale(zBitmapView *view, RECT *rect);
+void zBitmapBox(zBitmap * zbmp, RECT *rect, int r, int g, int b);
+void zBitmapFill(zBitmap * zbmp, RECT *rect, int r, int g, int b);
+void zBitmapGrayscale(zBitmap * zbmp, RECT *rect);
+
+zBitmap * loadScoreboardPooled(const char * file_name, zBitmapPool *pool);
+zBitmap * loadScoreboard(const char * file_name);
+// 8-bit RGB, non-interlaced PNGs skip libpng for a fused inflate/unfilter/convert loop (on by
+// default; the output is the same either way, this is for comparing the two)
+void zSetPngFastPath(int enabled);
+// Splits fast-path decoding across two threads, one inflating (a helper kept between images) while
+// the other unfilters, converts and (when streaming) analyzes. 0, the default, leaves it off; 1
+// turns it on; -1 uses it when there's more than one CPU.
+void zSetPngPipeline(int mode);
+
+// Writes zbmp as an ordinary 8-bit RGB PNG whose compressed data restarts every stripRows rows,
+// indexed by a private stRP chunk, so loadScoreboard can decode the strips on every core (other
+// decoders just ignore the index). level is zlib's 0-9. Returns 0 on failure.
+int zSaveStripedPng(zBitmap *zbmp, const char *file_name, int stripRows, int level);
+// Threads used for striped PNGs; 0, the default, means one per CPU, and 1 decodes them serially.
+// The threads belong to one pool kept until zPngShutdown.
+void zSetPngStripThreads(int threads);
+// Joins the pipeline's inflate helpers and the strip pool's threads; call it once no decode is
+// running (at exit, say). Decoding afterwards simply starts them again.
+void zPngShutdown(void);
+
+// ------------------------------------------------------------------------------------------------
+// File lists
+
+typedef struct zFileList
+{
+    char **names;
+    int count;
+    int capacity;
+} zFileList;
+
+void zFileListAdd(zFileList *list, const char *name);
+// adds a PNG, or every *.png under a directory (recursively)
+void zFileListAddPath(zFileList *list, const char *path);
+// zFileListAddPath for each line of listFile ("-" for stdin); returns 0 if it can't be opened
+int zFileListAddListFile(zFileList *list, const char *listFile);
+void zFileListSort(zFileList *list);
+void zFileListFree(zFileList *list);
+
+// ------------------------------------------------------------------------------------------------
+// Box search
+
+// returns true on a match
+typedef int (*zFindBoxPixelMatchFunc)(Pixel *pixel, void *userdata);
+
+// classifies count pixels of a row, bumping colCounts[i] for every match; returns the match total
+typedef int (*zFindBoxRowKernel)(Pixel *row, int count, void *userdata, int *colCounts);
+
+// One search for zViewFindBoxes. Fill in the inputs; colCounts/rowCounts may point at caller
+// arrays (view w / h entries) to get the histograms back, or be left NULL.
+typedef struct zFindBoxQuery
+{
+    RECT *subRect; // NULL for the whole view
+    zFindBoxPixelMatchFunc func;
+    void *userdata;
+    float lineToleranceX;
+    float lineToleranceY;
+
+    RECT outputRect;
+    int *colCounts;
+    int *rowCounts;
+} zFindBoxQuery;
+
+int zViewFindBox(zBitmapView *view, RECT *subRect, zFindBoxPixelMatchFunc func, void *userdata, float lineToleranceX, float lineToleranceY, RECT *outputRect, int debug);
+int zBitmapFindBox(zBitmap *zbmp, RECT *subRect, zFindBoxPixelMatchFunc func, void *userdata, float lineToleranceX, float lineToleranceY, RECT *outputRect, int debug);
+int zViewFindBoxParallel(zWorkerPool *pool, zBitmapView *view, RECT *subRect, zFindBoxPixelMatchFunc func, void *userdata, float lineToleranceX, float lineToleranceY, RECT *outputRect);
+int zBitmapFindBoxParallel(zWorkerPool *pool, zBitmap *zbmp, RECT *subRect, zFindBoxPixelMatchFunc func, void *userdata, float lineToleranceX, float lineToleranceY, RECT *outputRect);
+int zViewFindBoxes(zBitmapView *view, zFindBoxQuery *queries, int count);
+int zBitmapFindBoxes(zBitmap *zbmp, zFindBoxQuery *queries, int count);
+
+// ------------------------------------------------------------------------------------------------
+// Pixel predicates and color classes
+
+struct ColorList
+{
+    Pixel *colors;
+    int count;
+};
+
+struct GrayRange
+{
+    int tolerance;
+    int low;
+    int high;
+};
+
+extern struct GrayRange gChampBoxGray;
+
+int pixelMatchesColors(Pixel *pixel, void *userdata);
+int pixelIsAGray(Pixel *pixel, void *userdata);
+
+typedef struct zColorClass
+{
+    unsigned int *bits;
+} zColorClass;
+
+zColorClass * zColorClassCreate(void);
+void zColorClassDestroy(zColorClass *cc);
+void zColorClassAddColors(zColorClass *cc, struct ColorList *colorList);
+void zColorClassAddGrayRange(zColorClass *cc, struct GrayRange *range);
+void zColorClassAddFunc(zColorClass *cc, zFindBoxPixelMatchFunc func, void *userdata);
+int pixelInColorClass(Pixel *pixel, void *userdata);
+
+enum zKernelLevel
+{
+    Z_KERNEL_SCALAR = 0,
+    Z_KERNEL_SSE2,
+    Z_KERNEL_AVX2
+};
+
+int zGetKernelLevel(void);
+int zSetKernelLevel(int level);
+
+typedef struct zMatchTable
+{
+    int w;
+    int h;
+    int *sums;      // (w+1) * (h+1)
+    int *colCounts; // query scratch, w
+    int *rowCounts; // query scratch, h
+} zMatchTable;
+
+zMatchTable * zMatchTableCreateView(zBitmapView *view, zFindBoxPixelMatchFunc func, void *userdata);
+zMatchTable * zMatchTableCreate(zBitmap *zbmp, zFindBoxPixelMatchFunc func, void *userdata);
+void zMatchTableDestroy(zMatchTable *table);
+int zMatchTableCount(zMatchTable *table, RECT *rect);
+int zMatchTableFindBox(zMatchTable *table, RECT *subRect, float lineToleranceX, float lineToleranceY, RECT *outputRect);
+
+// ------------------------------------------------------------------------------------------------
+// Scoreboard
+
+#define MAX_CHAMPION_ROWS 64
+
+typedef struct ChampionRow
+{
+    int top;
+    int bottom;
+} ChampionRow;
+
+int findChampionRows(zBitmap *zbmp, RECT *facesBox, ChampionRow *rows, int maxRows);
+
+enum
+{
+    EDGE_LEFT = 0,
+    EDGE_TOP,
+    EDGE_RIGHT,
+    EDGE_BOTTOM,
+
+    EDGE_COUNT
+};
+
+typedef struct zTracker
+{
+    int valid;
+    int w;
+    int h;
+    RECT scoreBox;
+    RECT facesBox;
+    int scoreEdges[EDGE_COUNT];
+    int facesEdges[EDGE_COUNT];
+
+    int band;       // lines checked on either side of each stored edge
+    float slack;    // fraction an edge's count may drop before the box is considered lost
+
+    int hits;       // frames answered from the stored boxes
+    int misses;     // frames that needed a full search
+} zTracker;
+
+void zTrackerInit(zTracker *tracker);
+void zTrackerReset(zTracker *tracker);
+int zTrackerVerify(zTracker *tracker, zBitmap *zbmp, RECT *scoreBox, RECT *facesBox);
+void zTrackerUpdate(zTracker *tracker, zBitmap *zbmp, RECT *scoreBox, RECT *facesBox);
+
+typedef struct zLayout
+{
+    int w;
+    int h;
+    RECT scoreBox;
+    RECT facesBox;
+    int scoreEdges[EDGE_COUNT];
+    int rowCount;
+    ChampionRow rows[MAX_CHAMPION_ROWS];
+} zLayout;
+
+typedef struct zLayoutCache
+{
+    zLayout *layouts;
+    int count;
+    int capacity;
+    float slack;        // fraction an edge's count may drop before the layout is rejected
+
+    int hits;           // frames that skipped box detection
+    int misses;         // frames with no layout for their size
+    int invalidations;  // layouts dropped by a failed probe
+} zLayoutCache;
+
+zLayoutCache * zLayoutCacheCreate(void);
+void zLayoutCacheDestroy(zLayoutCache *cache);
+int zLayoutCacheSave(zLayoutCache *cache, const char *filename);
+int zLayoutCacheLoad(zLayoutCache *cache, const char *filename);
+
+// Stages timed by findScoreboard; Z_STAGE_DECODE is left for whoever produced the bitmap to fill in
+enum zStage
+{
+    Z_STAGE_DECODE = 0,
+    Z_STAGE_SCOREBOX,   // scorebox search, or the cache probe / tracker check that replaced it
+    Z_STAGE_FACESBOX,
+    Z_STAGE_ROWS,
+
+    Z_STAGE_COUNT
+};
+
+extern const char *zStageNames[Z_STAGE_COUNT];
+
+// Hardware counters attributed to each stage (Linux perf events; all zero elsewhere or when off)
+enum zCounter
+{
+    Z_COUNTER_CYCLES = 0,
+    Z_COUNTER_INSTRUCTIONS,
+    Z_COUNTER_CACHE_MISSES,
+    Z_COUNTER_BRANCH_MISSES,
+
+    Z_COUNTER_COUNT
+};
+
+extern const char *zCounterNames[Z_COUNTER_COUNT];
+
+typedef struct zScoreboardInfo
+{
+    RECT scoreBox;
+    RECT facesBox;
+    int rowCount;
+    ChampionRow rows[MAX_CHAMPION_ROWS];
+    double stageMs[Z_STAGE_COUNT];
+    unsigned long long stageCounters[Z_STAGE_COUNT][Z_COUNTER_COUNT];
+} zScoreboardInfo;
+
+// Timing (and counting) of one stage: zStageBegin, do the work, zStageEnd stores the elapsed ms
+// and counter deltas in info. Callers use it for Z_STAGE_DECODE; findScoreboard for the rest.
+typedef struct zStageMark
+{
+    double start;
+    unsigned long long counters[Z_COUNTER_COUNT];   // raw counts, scaled for multiplexing at the end
+    unsigned long long timeEnabled;
+    unsigned long long timeRunning;
+} zStageMark;
+
+void zStageBegin(zStageMark *mark);
+void zStageEnd(zStageMark *mark, zScoreboardInfo *info, int stage);
+
+// Turns on per-stage hardware counters for every thread that times a stage (each opens its own
+// events the first time). Returns 0 if the events can't be opened here, e.g. off Linux, without a
+// PMU, or with perf_event_paranoid too strict.
+int zCountersEnable(void);
+
+// Builds the shared color classes and picks the row kernel. Call once before analyzing from
+// several threads; findScoreboard does it lazily otherwise.
+void zScoreboardInit(void);
+void findScoreboard(zBitmap *zbmp, zTracker *tracker, zLayoutCache *cache, zScoreboardInfo *info);
+void findThings(zBitmap *zbmp);
+
+// ------------------------------------------------------------------------------------------------
+// Streaming analysis
+//
+// Analyzes rows as they're decoded instead of after the whole image is in memory. Each pushed row
+// is folded into the scorebox row/column histograms and into a 1-bit-per-pixel champion-gray mask,
+// which is all the facesBox search and the champion row walk need, so the result is identical to
+// findScoreboard's while only one row of pixels is ever held. With earlyStop, pushing stops paying
+// off once a bottom scorebox edge has been followed by enough rows without a better one; whatever
+// is below the scoreboard is never decoded (the boxes may then differ slightly from a full pass).
+
+typedef struct zStreamAnalyzer
+{
+    int w;
+    int h;
+    int earlyStop;
+    int rowsPushed;
+    int *colCounts;             // scorebox histograms
+    int *rowCounts;
+    unsigned int *grayMask;     // champion-gray bit per pixel, maskWords per row
+    int maskWords;
+    int bestRowCount;           // running scorebox top/bottom candidates, for earlyStop
+    int topRow;
+    int bottomRow;
+    double classifyMs;
+} zStreamAnalyzer;
+
+typedef struct zStreamStats
+{
+    int w;
+    int h;
+    int rowsDecoded;
+} zStreamStats;
+
+#define Z_STREAM_EARLY_STOP 1
+
+zStreamAnalyzer * zStreamAnalyzerCreate(int w, int h, int earlyStop);
+void zStreamAnalyzerDestroy(zStreamAnalyzer *stream);
+// row is w pixels, rows must arrive top to bottom; returns 0 once no further rows are wanted
+int zStreamAnalyzerPushRow(zStreamAnalyzer *stream, Pixel *row);
+// fills everything but info's decode stage; hardware counters aren't split per stage here
+void zStreamAnalyzerFinish(zStreamAnalyzer *stream, zScoreboardInfo *info);
+
+// Decodes file_name row by row into a zStreamAnalyzer (flags: Z_STREAM_*), through the same 8-bit
+// RGB fast path and decode pipeline as loadScoreboard where they apply. Interlaced PNGs need
+// every pass before any row is final, so they're decoded whole and then streamed. stats may be
+// NULL. Returns 0 if the file can't be loaded.
+int loadScoreboardStreaming(const char *file_name, int flags, zScoreboardInfo *info, zStreamStats *stats);
+
+// ------------------------------------------------------------------------------------------------
+// Frame differencing
+
+#define Z_DIFF_TILE 32
+
+// Per-tile hashes of the last frame, so the next one can tell which tiles changed
+typedef struct zFrameDiff
+{
+    int w;
+    int h;
+    int tilesX;
+    int tilesY;
+    unsigned int *hashes;       // last frame's tile hashes, row-major
+    unsigned char *changed;     // per tile: differs from the frame before
+    int valid;                  // hashes hold a w x h frame
+
+    long frames;                // frames hashed
+    double hashMs;              // total time spent hashing them
+    long skipped;               // frames zPipeline didn't analyze at all
+    long rowsOnly;              // frames zPipeline kept the boxes and rows of
+} zFrameDiff;
+
+zFrameDiff * zFrameDiffCreate(void);
+void zFrameDiffDestroy(zFrameDiff *diff);
+// Hashes zbmp's tiles and compares them with the previous frame's. Returns the number of changed
+// tiles, or -1 when the previous frame was missing or of another size (everything counts as changed).
+int zFrameDiffUpdate(zFrameDiff *diff, zBitmap *zbmp);
+// Changed tiles overlapping an inclusive box, as FindBox returns them
+int zFrameDiffCount(zFrameDiff *diff, RECT *box);
+
+// ------------------------------------------------------------------------------------------------
+// Capture/analysis pipeline
+
+enum zFrameState
+{
+    Z_FRAME_FREE = 0,
+    Z_FRAME_WRITING,
+    Z_FRAME_READY,
+    Z_FRAME_READING
+};
+
+typedef struct zFrameSlot
+{
+    volatile long state;    // zFrameState; every transition is an atomic exchange or CAS
+    volatile unsigned int sequence; // order frames were committed in; atomic, as the producer may
+                                    // rewrite a READY slot while the consumer compares them
+    double captureTime;     // zTimeNow at commit
+    zBitmap *bitmap;
+
+    // Region capture: the producer may ask for just part of a requestW x requestH frame. bitmap
+    // then holds region of a frameW x frameH frame; rects are [left,right) x [top,bottom).
+    RECT request;           // empty for the whole frame
+    int requestW;
+    int requestH;
+    RECT region;
+    int frameW;
+    int frameH;
+} zFrameSlot;
+
+typedef struct zFrameRing
+{
+    zFrameSlot *slots;
+    int count;
+    unsigned int nextSequence; // producer only
+
+    volatile long committed;
+    volatile long dropped;  // committed frames overwritten before the consumer got to them
+    volatile long consumed;
+} zFrameRing;
+
+zFrameRing * zFrameRingCreate(int count);
+void zFrameRingDestroy(zFrameRing *ring);
+zFrameSlot * zFrameRingAcquireWrite(zFrameRing *ring);
+void zFrameSlotResize(zFrameSlot *slot, int w, int h);
+// For sources that know their full frameW x frameH: settles slot->region (the request if it fits
+// that frame, else everything) and sizes the bitmap to it
+void zFrameSlotPrepare(zFrameSlot *slot, int frameW, int frameH);
+// Copies slot->region out of a whole frame whose rows are stride pixels apart
+void zFrameSlotCopyRegion(zFrameSlot *slot, const Pixel *frame, int stride);
+void zFrameRingCommit(zFrameRing *ring, zFrameSlot *slot);
+void zFrameRingAbandon(zFrameRing *ring, zFrameSlot *slot);
+zFrameSlot * zFrameRingAcquireRead(zFrameRing *ring);
+void zFrameRingRelease(zFrameRing *ring, zFrameSlot *slot);
+
+// How much of a frame the pipeline actually looked at (see zPipelineCreate's diff)
+enum zAnalysis
+{
+    Z_ANALYSIS_FULL = 0,    // findScoreboard
+    Z_ANALYSIS_ROWS,        // boxes and row spans unchanged; only the rows in changedRows differ
+    Z_ANALYSIS_SKIPPED      // nothing in the scorebox changed; info is the previous frame's
+};
+
+typedef struct zFrameResult
+{
+    unsigned int sequence;
+    double captureTime;
+    double analyzedTime;
+    int analysis;                   // zAnalysis
+    RECT region;                    // part of the frame that was captured ([left,right) x [top,bottom))
+    unsigned long long changedRows; // bit k: info.rows[k] overlaps a changed tile (all set after a full analysis)
+    double hashMs;                  // tile hashing, 0 without a diff
+    zScoreboardInfo info;
+} zFrameResult;
+
+// Single-writer single-reader latest-value box (a triple buffer)
+typedef struct zResultMailbox
+{
+    zFrameResult buffers[3];
+    int back;               // writer only
+    volatile long middle;   // buffer index, plus MAILBOX_FRESH once the writer has swapped one in
+    int front;              // reader only
+
+    // What results published since the last take changed, so a newer result that replaces one
+    // before the reader sees it doesn't lose its changes: changedRows (low and high 32 bits) and
+    // whether any of them was a full analysis. Set by publish, folded in and cleared by take.
+    volatile long pendingRows[2];
+    volatile long pendingFull;
+} zResultMailbox;
+
+void zResultMailboxInit(zResultMailbox *mailbox);
+void zResultMailboxPublish(zResultMailbox *mailbox, zFrameResult *result);
+// The newest result, reporting every change since the last take: a full analysis or changed rows
+// in results it replaced carry over (so it may report a little more than its own frame changed,
+// never less)
+int zResultMailboxTake(zResultMailbox *mailbox, zFrameResult *result);
+
+// Fills slot->bitmap (zFrameSlotResize it first if the size is off); returns 0 when there was no
+// frame to grab this time. Captures that can read back part of a frame call zFrameSlotPrepare to
+// honor slot->request; the rest just fill the whole frame.
+typedef int (*zCaptureFunc)(void *context, zFrameSlot *slot);
+
+// Region-of-interest policy: once a full frame has shown the scoreboard, ask for just its scorebox
+// plus margin, and go back to full frames as soon as a region fails to show the whole scoreboard.
+// Independent of how frames are captured; the pipeline drives it from both threads.
+typedef struct zRoi
+{
+    zMutex lock;
+    int enabled;
+    int margin;
+    int frameW;             // frame size rect applies to
+    int frameH;
+    RECT rect;              // [left,right) x [top,bottom); empty while full frames are needed
+    RECT box;               // the scorebox rect was made from
+
+    volatile long regionFrames; // frames analyzed from a region
+    volatile long fullFrames;
+    volatile long fallbacks;    // regions abandoned because the scoreboard didn't fit in them
+} zRoi;
+
+void zRoiInit(zRoi *roi);
+void zRoiDestroy(zRoi *roi);
+// margin < 0 turns region capture off
+void zRoiSetMargin(zRoi *roi, int margin);
+// Capture side: fills in slot->request for the next frame
+void zRoiRequest(zRoi *roi, zFrameSlot *slot);
+// Analysis side, with info in frame coordinates: returns 0 if slot was a region and the scoreboard
+// wasn't found wholly inside it, in which case info can't be trusted and full frames resume
+int zRoiUpdate(zRoi *roi, zFrameSlot *slot, zScoreboardInfo *info);
+
+typedef struct zPipeline
+{
+    zFrameRing *ring;
+    zResultMailbox results;
+    zCaptureFunc capture;
+    void *captureContext;
+    double intervalMs;      // capture period, 0 for as fast as the source allows
+
+    zTracker tracker;
+    zLayoutCache *cache;    // may be NULL
+    zFrameDiff *diff;       // may be NULL
+    zRoi roi;               // off unless zPipelineSetRoiMargin
+    zFrameResult last;      // analysis thread only: the previous result, for the diff
+    int haveLast;
+
+    zThread captureThread;
+    zThread analysisThread;
+    zMutex wakeLock;
+    zCond wake;
+    volatile long analysisSleeping;
+    volatile long quit;
+    int stopped;            // threads joined; only touched by whoever owns the pipeline
+
+    long analyzed;          // analysis thread only
+} zPipeline;
+
+zPipeline * zPipelineCreate(int ringSize, double intervalMs, zCaptureFunc capture, void *captureContext, zLayoutCache *cache, zFrameDiff *diff);
+// Joins the capture and analysis threads, after which their state (tracker, counters) can be read
+// until zPipelineDestroy, which stops the pipeline itself if this wasn't called
+void zPipelineStop(zPipeline *pipeline);
+void zPipelineDestroy(zPipeline *pipeline);
+int zPipelineLatest(zPipeline *pipeline, zFrameResult *result);
+// Captures only the scorebox plus margin pixels once it's been found (< 0 turns it back off)
+void zPipelineSetRoiMargin(zPipeline *pipeline, int margin);
+
+// ------------------------------------------------------------------------------------------------
+// Frame sources
+
+// Where a pipeline's frames come from. Backends embed this first and fill in read/destroy; see
+// zFrameSourceCapture for plugging one into zPipelineCreate. Recorded sources loop forever.
+typedef struct zFrameSource
+{
+    const char *name;
+    int (*read)(struct zFrameSource *source, zFrameSlot *slot); // as a zCaptureFunc
+    void (*destroy)(struct zFrameSource *source);
+    double fps;             // rate to play at, 0 for as fast as the source allows
+    int w;                  // frame size, 0 if it varies or isn't known up front
+    int h;
+    long frameCount;        // frames before the source loops, 0 for endless
+    long frames;            // frames read so far
+} zFrameSource;
+
+// Decodes files in order (the list is copied)
+zFrameSource * zFrameSourceCreatePngs(zFileList *files, double fps);
+// Memory-maps back-to-back w*h BGRA frames, top row first, as GetDIBits or
+// "ffmpeg -pix_fmt bgra -f rawvideo" write them; returns NULL if the file can't be mapped
+zFrameSource * zFrameSourceCreateRaw(const char *filename, int w, int h, double fps);
+// A generated scoreboard at any size whose timer ticks along with fps
+zFrameSource * zFrameSourceCreateSynthetic(int w, int h, double fps);
+void zFrameSourceDestroy(zFrameSource *source);
+// zCaptureFunc for a zFrameSource context; pair it with zFrameSourceInterval as the pipeline period
+int zFrameSourceCapture(void *context, zFrameSlot *slot);
+double zFrameSourceInterval(zFrameSource *source);
+
+// The synthetic scoreboard itself: a noise background, the scorebox outline and a column of
+// champion face boxes, plus a game timer drawn for the given second
+zBitmap * zSyntheticScoreboardCreate(int w, int h);
+// zbmp holds the part of a frameW x frameH frame whose top left corner is at (originX, originY)
+void zSyntheticScoreboardDrawTimer(zBitmap *zbmp, int frameW, int frameH, int originX, int originY, int seconds);
+
+#endif
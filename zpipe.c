@@ -0,0 +1,324 @@
+// zpipe: load-tests the capture/analysis pipeline with a headless frame source.
+//
+//   zpipe [-f fps] [-d seconds] [-r ringsize] [-c] [-s] [-m margin] [-t] [source ...]
+//
+// The source is one of
+//
+//   path ...                 PNGs and/or directories of them, played in sorted order
+//   raw:WxH:file             a memory-mapped recording of raw BGRA frames
+//   synth:WxH                a generated scoreboard whose timer ticks every second
+//
+// (images/board1.png by default), captured at fps (0 for as fast as possible, which exercises
+// drop-oldest backpressure). The main thread plays the UI: it polls the latest result at 60 Hz and
+// checks that sequence numbers only move forward and, for sources that repeat a single frame, that
+// every frame got the same boxes. The summary includes the tracker's hits and misses (frames whose
+// boxes were re-verified rather than searched for). -c enables the layout cache and reports its
+// hits, misses and invalidations; -s enables tile differencing, so frames with an unchanged
+// scorebox skip analysis, and reports how many did and what hashing cost.
+// -m captures just the scorebox plus margin pixels once it's been found (region of interest).
+// -t instead checks that results replaced in the mailbox before the UI takes one keep their changes.
+
+#include "zcore.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: zpipe [-f fps] [-d seconds] [-r ringsize] [-c] [-s] [-m margin] [-t] [path ... | raw:WxH:file | synth:WxH]\n");
+}
+
+// ------------------------------------------------------------------------------------------------
+// Mailbox checks (-t)
+//
+// The UI polls far less often than frames are analyzed, so results routinely replace each other
+// in the mailbox before anyone looks. Whatever the UI does take must still report every change.
+
+static void publish(zResultMailbox *mailbox, unsigned int sequence, int analysis, unsigned long long changedRows)
+{
+    zFrameResult result;
+    memset(&result, 0, sizeof(result));
+    result.sequence = sequence;
+    result.analysis = analysis;
+    result.changedRows = changedRows;
+    result.info.rowCount = 10;
+    zResultMailboxPublish(mailbox, &result);
+}
+
+static int expectTake(zResultMailbox *mailbox, const char *what, unsigned int sequence, int analysis, unsigned long long changedRows)
+{
+    zFrameResult result;
+    if(!zResultMailboxTake(mailbox, &result))
+    {
+        printf("FAIL %s: nothing to take\n", what);
+        return 1;
+    }
+    if((result.sequence != sequence) || (result.analysis != analysis) || (result.changedRows != changedRows))
+    {
+        printf("FAIL %s: took sequence %u, analysis %d, rows %llx; expected %u, %d, %llx\n", what,
+            result.sequence, result.analysis, result.changedRows, sequence, analysis, changedRows);
+        return 1;
+    }
+    printf("ok   %s\n", what);
+    return 0;
+}
+
+static int checkMailbox(void)
+{
+    zResultMailbox mailbox;
+    zFrameResult result;
+    int failures = 0;
+
+    zResultMailboxInit(&mailbox);
+    publish(&mailbox, 1, Z_ANALYSIS_ROWS, 0x5);
+    publish(&mailbox, 2, Z_ANALYSIS_SKIPPED, 0);
+    failures += expectTake(&mailbox, "rows, then skipped, before a take", 2, Z_ANALYSIS_ROWS, 0x5);
+
+    publish(&mailbox, 3, Z_ANALYSIS_ROWS, 0x1);
+    publish(&mailbox, 4, Z_ANALYSIS_ROWS, 1ULL << 40);
+    publish(&mailbox, 5, Z_ANALYSIS_ROWS, 0x2);
+    failures += expectTake(&mailbox, "several rows results before a take", 5, Z_ANALYSIS_ROWS, 0x3 | (1ULL << 40));
+
+    publish(&mailbox, 6, Z_ANALYSIS_FULL, 0x3ff);
+    publish(&mailbox, 7, Z_ANALYSIS_SKIPPED, 0);
+    failures += expectTake(&mailbox, "full, then skipped, before a take", 7, Z_ANALYSIS_FULL, 0x3ff);
+
+    if(zResultMailboxTake(&mailbox, &result))
+    {
+        printf("FAIL a second take got a result\n");
+        ++failures;
+    }
+    publish(&mailbox, 8, Z_ANALYSIS_SKIPPED, 0);
+    failures += expectTake(&mailbox, "nothing carried past a take", 8, Z_ANALYSIS_SKIPPED, 0);
+
+    printf("%d mailbox check failures\n", failures);
+    return failures ? 1 : 0;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    zFileList files;
+    zFrameSource *source = NULL;
+    zLayoutCache *cache = NULL;
+    zFrameDiff *diff = NULL;
+    zPipeline *pipeline;
+    zFrameResult result;
+    zFrameResult first;
+    double fps = 60.0;
+    double seconds = 3.0;
+    int ringSize = 4;
+    int useCache = 0;
+    int useDiff = 0;
+    int roiMargin = -1;
+    long regionFrames, fullFrames, fallbacks;
+    int trackerHits, trackerMisses;
+    int updates = 0;
+    int mismatches = 0;
+    int backwards = 0;
+    unsigned int lastSequence = 0;
+    double latencyTotal = 0.0;
+    double latencyMax = 0.0;
+    double start;
+    long committed, dropped, analyzed;
+    const char *spec = NULL;
+    int w, h, consumed;
+    int i;
+
+    memset(&files, 0, sizeof(zFileList));
+    for(i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-f") && (i + 1 < argc))
+        {
+            fps = atof(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-d") && (i + 1 < argc))
+        {
+            seconds = atof(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-r") && (i + 1 < argc))
+        {
+            ringSize = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-c"))
+        {
+            useCache = 1;
+        }
+        else if(!strcmp(argv[i], "-s"))
+        {
+            useDiff = 1;
+        }
+        else if(!strcmp(argv[i], "-m") && (i + 1 < argc))
+        {
+            roiMargin = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-t"))
+        {
+            return checkMailbox();
+        }
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else if(!strncmp(argv[i], "raw:", 4) || !strncmp(argv[i], "synth:", 6))
+        {
+            spec = argv[i];
+        }
+        else
+        {
+            zFileListAddPath(&files, argv[i]);
+        }
+    }
+
+    if(spec && !strncmp(spec, "raw:", 4))
+    {
+        consumed = 0;
+        if((sscanf(spec + 4, "%dx%d:%n", &w, &h, &consumed) != 2) || (consumed == 0))
+        {
+            usage();
+            return 1;
+        }
+        source = zFrameSourceCreateRaw(spec + 4 + consumed, w, h, fps);
+    }
+    else if(spec)
+    {
+        if((sscanf(spec + 6, "%dx%d", &w, &h) != 2) || (w < 64) || (h < 64))
+        {
+            usage();
+            return 1;
+        }
+        source = zFrameSourceCreateSynthetic(w, h, fps);
+    }
+    else
+    {
+        if(files.count == 0)
+        {
+            zFileListAdd(&files, "images/board1.png");
+        }
+        zFileListSort(&files);
+        source = zFrameSourceCreatePngs(&files, fps);
+    }
+    zFileListFree(&files);
+    if(!source)
+    {
+        return 1;
+    }
+    zSetVerbose(0);
+    if(useCache)
+    {
+        cache = zLayoutCacheCreate();
+    }
+    if(useDiff)
+    {
+        diff = zFrameDiffCreate();
+    }
+
+    pipeline = zPipelineCreate(ringSize, zFrameSourceInterval(source), zFrameSourceCapture, source, cache, diff);
+    zPipelineSetRoiMargin(pipeline, roiMargin);
+    start = zTimeNow();
+    while(zTimeNow() - start < seconds * 1000.0)
+    {
+        zSleepMs(1000.0 / 60.0);
+        if(!zPipelineLatest(pipeline, &result))
+        {
+            continue;
+        }
+        if(updates == 0)
+        {
+            memcpy(&first, &result, sizeof(zFrameResult));
+        }
+        else
+        {
+            if((int)(result.sequence - lastSequence) <= 0)
+            {
+                ++backwards;
+            }
+            if(memcmp(&first.info.scoreBox, &result.info.scoreBox, sizeof(RECT))
+            || memcmp(&first.info.facesBox, &result.info.facesBox, sizeof(RECT))
+            || (first.info.rowCount != result.info.rowCount))
+            {
+                ++mismatches;
+            }
+        }
+        lastSequence = result.sequence;
+        latencyTotal += result.analyzedTime - result.captureTime;
+        if(result.analyzedTime - result.captureTime > latencyMax)
+        {
+            latencyMax = result.analyzedTime - result.captureTime;
+        }
+        ++updates;
+    }
+    zPipelineStop(pipeline);
+    trackerHits = pipeline->tracker.hits;
+    trackerMisses = pipeline->tracker.misses;
+    committed = zAtomicLoad(&pipeline->ring->committed);
+    dropped = zAtomicLoad(&pipeline->ring->dropped);
+    regionFrames = zAtomicLoad(&pipeline->roi.regionFrames);
+    fullFrames = zAtomicLoad(&pipeline->roi.fullFrames);
+    fallbacks = zAtomicLoad(&pipeline->roi.fallbacks);
+    zPipelineDestroy(pipeline);
+    analyzed = committed - dropped;
+
+    // a recording of several frames may legitimately change layout between them
+    if(source->frameCount > 1)
+    {
+        mismatches = 0;
+    }
+
+    printf("%s source", source->name);
+    if(source->w > 0)
+    {
+        printf(" %dx%d", source->w, source->h);
+    }
+    if(source->frameCount > 0)
+    {
+        printf(", %ld frames", source->frameCount);
+    }
+    printf(", ring %d, %.0f fps requested, %.1f s\n", ringSize, fps, seconds);
+    printf("captured %ld frames (%.1f/s), dropped %ld, analyzed ~%ld, %d UI updates\n",
+        committed, committed / seconds, dropped, analyzed, updates);
+    printf("capture-to-result latency mean %.2f ms, max %.2f ms\n", updates ? (latencyTotal / updates) : 0.0, latencyMax);
+    if(updates > 0)
+    {
+        printf("first scoreBox [%d, %d, %d, %d], %d rows; %d mismatched results, %d out-of-order\n",
+            first.info.scoreBox.left, first.info.scoreBox.top, first.info.scoreBox.right, first.info.scoreBox.bottom,
+            first.info.rowCount, mismatches, backwards);
+    }
+
+    // frames the layout cache answered never reach the tracker
+    printf("tracker: %d hits, %d misses (%.1f%% of searches replaced by a band check)\n", trackerHits, trackerMisses,
+        (trackerHits + trackerMisses > 0) ? (100.0 * trackerHits / (trackerHits + trackerMisses)) : 0.0);
+    if(cache)
+    {
+        printf("layout cache: %d hits, %d misses, %d invalidations, %d layouts\n",
+            cache->hits, cache->misses, cache->invalidations, cache->count);
+    }
+    if(roiMargin >= 0)
+    {
+        printf("region capture: %ld of %ld analyzed frames from a region, %ld fallbacks to full frames\n",
+            regionFrames, regionFrames + fullFrames, fallbacks);
+    }
+    if(diff && (diff->frames > 0))
+    {
+        double pixels = (double)diff->w * diff->h;
+        printf("tile diff: %ld of %ld frames skipped (%.1f%%), %ld rows-only; hashing %.3f ms/frame (%.0f MB/s)\n",
+            diff->skipped, diff->frames, 100.0 * diff->skipped / diff->frames, diff->rowsOnly,
+            diff->hashMs / diff->frames,
+            (diff->hashMs > 0.0) ? (pixels * sizeof(Pixel) * diff->frames / (diff->hashMs * 1000.0)) : 0.0);
+    }
+
+    if(cache)
+    {
+        zLayoutCacheDestroy(cache);
+    }
+    if(diff)
+    {
+        zFrameDiffDestroy(diff);
+    }
+    zFrameSourceDestroy(source);
+    zPngShutdown();
+    return (updates > 0 && !mismatches && !backwards) ? 0 : 1;
+}
@@ -0,0 +1,958 @@
+// zregress: golden-output and timing regression check over images/.
+//
+//   zregress [-e expected] [-b baseline] [-n runs] [-t threshold] [-m minms] [-s] [-r] [-g] [-k]
+//
+// The expected file (images/expected.txt, checked in) lists each image with the scoreBox, facesBox
+// and champion row spans findScoreboard must produce for it; any difference fails. Each image is
+// decoded and analyzed runs times and the median of every stage is compared against the baseline
+// file, which holds timings from the same machine (build/baseline.txt by default, not checked in).
+// A stage fails when its median exceeds the baseline by more than threshold (a fraction, 0.25 by
+// default) and by more than minms, so sub-microsecond stages don't fail on noise.
+//
+// -s checks the streaming analyzer (loadScoreboardStreaming) instead, which must produce the same
+// boxes; its stage timings differ, so its default baseline is build/baseline-stream.txt.
+//
+// -r rewrites the baseline from the current timings; detection is still checked against the
+// expected file. -g rewrites the expected file from the current detection, for when a change to
+// detection is intended; it can't be combined with -s, as the streaming analyzer is held to what
+// findScoreboard produces rather than the other way around.
+//
+// -k runs the self-checks instead: the SIMD kernels and the other fast paths against the plain
+// code they stand in for, on the images and on random frames (see Self-checks below).
+
+#include "zcore.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef struct Expected
+{
+    char file[256];
+    zScoreboardInfo info;
+    double baselineMs[Z_STAGE_COUNT];   // negative when there's no baseline for the image
+} Expected;
+
+#define MAX_EXPECTED 64
+
+static Expected sExpected[MAX_EXPECTED];
+static int sExpectedCount = 0;
+
+// ------------------------------------------------------------------------------------------------
+// Files
+//
+// expected: file  scoreL T R B  facesL T R B  rowCount  rowTop rowBottom ...
+// baseline: file  decodeMs scoreboxMs facesboxMs rowsMs
+// Lines starting with # are comments.
+
+static Expected * findExpected(const char *file)
+{
+    int i;
+    for(i = 0; i < sExpectedCount; ++i)
+    {
+        if(!strcmp(sExpected[i].file, file))
+        {
+            return &sExpected[i];
+        }
+    }
+    return NULL;
+}
+
+static int readExpected(const char *filename)
+{
+    char line[4096];
+    FILE *f = fopen(filename, "r");
+    if(!f)
+    {
+        perror(filename);
+        return 0;
+    }
+    while(fgets(line, sizeof(line), f) && (sExpectedCount < MAX_EXPECTED))
+    {
+        Expected *e = &sExpected[sExpectedCount];
+        zScoreboardInfo *info = &e->info;
+        char *p = line;
+        int consumed;
+        int k;
+
+        if((line[0] == '#') || (line[0] == '\n'))
+        {
+            continue;
+        }
+        if(sscanf(p, "%255s %d %d %d %d %d %d %d %d %d%n", e->file,
+            &info->scoreBox.left, &info->scoreBox.top, &info->scoreBox.right, &info->scoreBox.bottom,
+            &info->facesBox.left, &info->facesBox.top, &info->facesBox.right, &info->facesBox.bottom,
+            &info->rowCount, &consumed) != 10)
+        {
+            fprintf(stderr, "%s: bad line: %s", filename, line);
+            fclose(f);
+            return 0;
+        }
+        p += consumed;
+        if((info->rowCount < 0) || (info->rowCount > MAX_CHAMPION_ROWS))
+        {
+            fprintf(stderr, "%s: bad row count for %s\n", filename, e->file);
+            fclose(f);
+            return 0;
+        }
+        for(k = 0; k < info->rowCount; ++k)
+        {
+            if(sscanf(p, "%d %d%n", &info->rows[k].top, &info->rows[k].bottom, &consumed) != 2)
+            {
+                fprintf(stderr, "%s: missing rows for %s\n", filename, e->file);
+                fclose(f);
+                return 0;
+            }
+            p += consumed;
+        }
+        for(k = 0; k < Z_STAGE_COUNT; ++k)
+        {
+            e->baselineMs[k] = -1.0;
+        }
+        ++sExpectedCount;
+    }
+    fclose(f);
+    return 1;
+}
+
+static void readBaseline(const char *filename)
+{
+    char line[1024];
+    char file[256];
+    double ms[Z_STAGE_COUNT];
+    FILE *f = fopen(filename, "r");
+    if(!f)
+    {
+        return;
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+        Expected *e;
+        if(line[0] == '#')
+        {
+            continue;
+        }
+        if(sscanf(line, "%255s %lf %lf %lf %lf", file, &ms[0], &ms[1], &ms[2], &ms[3]) != 1 + Z_STAGE_COUNT)
+        {
+            continue;
+        }
+        e = findExpected(file);
+        if(e)
+        {
+            memcpy(e->baselineMs, ms, sizeof(ms));
+        }
+    }
+    fclose(f);
+}
+
+static int writeExpected(const char *filename)
+{
+    int i, k;
+    FILE *f = fopen(filename, "w");
+    if(!f)
+    {
+        perror(filename);
+        return 0;
+    }
+    fprintf(f, "# file  scoreBox(l t r b)  facesBox(l t r b)  rowCount  rows(top bottom)...\n");
+    for(i = 0; i < sExpectedCount; ++i)
+    {
+        zScoreboardInfo *info = &sExpected[i].info;
+        fprintf(f, "%s  %d %d %d %d  %d %d %d %d  %d", sExpected[i].file,
+            info->scoreBox.left, info->scoreBox.top, info->scoreBox.right, info->scoreBox.bottom,
+            info->facesBox.left, info->facesBox.top, info->facesBox.right, info->facesBox.bottom,
+            info->rowCount);
+        for(k = 0; k < info->rowCount; ++k)
+        {
+            fprintf(f, " %d %d", info->rows[k].top, info->rows[k].bottom);
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return 1;
+}
+
+static int writeBaseline(const char *filename)
+{
+    int i, k;
+    FILE *f = fopen(filename, "w");
+    if(!f)
+    {
+        perror(filename);
+        return 0;
+    }
+    fprintf(f, "# file");
+    for(k = 0; k < Z_STAGE_COUNT; ++k)
+    {
+        fprintf(f, " %sMs", zStageNames[k]);
+    }
+    fprintf(f, "\n");
+    for(i = 0; i < sExpectedCount; ++i)
+    {
+        fprintf(f, "%s", sExpected[i].file);
+        for(k = 0; k < Z_STAGE_COUNT; ++k)
+        {
+            fprintf(f, " %.4f", sExpected[i].baselineMs[k]);
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Checking
+
+static int sameInfo(zScoreboardInfo *a, zScoreboardInfo *b)
+{
+    int k;
+    if(memcmp(&a->scoreBox, &b->scoreBox, sizeof(RECT)) || memcmp(&a->facesBox, &b->facesBox, sizeof(RECT)))
+    {
+        return 0;
+    }
+    if(a->rowCount != b->rowCount)
+    {
+        return 0;
+    }
+    for(k = 0; k < a->rowCount; ++k)
+    {
+        if((a->rows[k].top != b->rows[k].top) || (a->rows[k].bottom != b->rows[k].bottom))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void printInfo(const char *label, zScoreboardInfo *info)
+{
+    int k;
+    printf("    %s scoreBox [%d, %d, %d, %d] facesBox [%d, %d, %d, %d] rows", label,
+        info->scoreBox.left, info->scoreBox.top, info->scoreBox.right, info->scoreBox.bottom,
+        info->facesBox.left, info->facesBox.top, info->facesBox.right, info->facesBox.bottom);
+    for(k = 0; k < info->rowCount; ++k)
+    {
+        printf(" %d-%d", info->rows[k].top, info->rows[k].bottom);
+    }
+    printf("\n");
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+// Runs the pipeline runs times; fills info from the first run and medianMs per stage. Returns 0 if
+// the image can't be loaded or a later run disagrees with the first.
+static int analyze(const char *path, int runs, int streaming, zScoreboardInfo *info, double *medianMs)
+{
+    double *samples = calloc(runs * Z_STAGE_COUNT, sizeof(double));
+    int ok = 1;
+    int r, k;
+
+    for(r = 0; r < runs; ++r)
+    {
+        zScoreboardInfo runInfo;
+        zStageMark mark;
+        zBitmap *zbmp;
+        if(streaming)
+        {
+            if(!loadScoreboardStreaming(path, 0, &runInfo, NULL))
+            {
+                ok = 0;
+                break;
+            }
+        }
+        else
+        {
+            zStageBegin(&mark);
+            zbmp = loadScoreboard(path);
+            if(!zbmp)
+            {
+                ok = 0;
+                break;
+            }
+            zStageEnd(&mark, &runInfo, Z_STAGE_DECODE);
+            findScoreboard(zbmp, NULL, NULL, &runInfo);
+            zBitmapDestroy(zbmp);
+        }
+
+        if(r == 0)
+        {
+            memcpy(info, &runInfo, sizeof(zScoreboardInfo));
+        }
+        else if(!sameInfo(info, &runInfo))
+        {
+            printf("    run %d disagrees with run 0\n", r);
+            ok = 0;
+            break;
+        }
+        for(k = 0; k < Z_STAGE_COUNT; ++k)
+        {
+            samples[k * runs + r] = runInfo.stageMs[k];
+        }
+    }
+
+    if(ok)
+    {
+        for(k = 0; k < Z_STAGE_COUNT; ++k)
+        {
+            qsort(&samples[k * runs], runs, sizeof(double), compareDoubles);
+            medianMs[k] = samples[k * runs + (runs / 2)];
+        }
+    }
+    free(samples);
+    return ok;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Self-checks
+//
+// -k checks that the optimized paths give exactly what they replace, at every kernel level the CPU
+// supports. Inputs are the images plus random frames of awkward widths, searched over random
+// sub-rects, so the SIMD loops and their scalar tails both get exercised.
+
+static const char *sLevelNames[] = { "scalar", "sse2", "avx2" };
+static unsigned int sRandom = 12345;
+
+// [0, n)
+static int randomInt(int n)
+{
+    sRandom = (sRandom * 1103515245u) + 12345u;
+    return (int)((sRandom >> 8) % (unsigned int)n);
+}
+
+static void randomSubRect(zBitmap *zbmp, RECT *sub)
+{
+    sub->left = randomInt(zbmp->w);
+    sub->right = sub->left + 1 + randomInt(zbmp->w - sub->left);
+    sub->top = randomInt(zbmp->h);
+    sub->bottom = sub->top + 1 + randomInt(zbmp->h - sub->top);
+}
+
+// Noise leaning towards the colors the predicates look for, so there are plenty of hits, misses
+// and near misses; alpha is random since nothing is supposed to look at it
+static zBitmap * randomBitmap(int w, int h, struct ColorList *colorList)
+{
+    zBitmap *zbmp = zBitmapCreate(w, h);
+    int i;
+    for(i = 0; i < w * h; ++i)
+    {
+        Pixel *pixel = &zbmp->pixels[i];
+        int kind = randomInt(3);
+        if(kind == 0)
+        {
+            int v = 12 + randomInt(74);
+            pixelSet(pixel, v + randomInt(13) - 6, v + randomInt(13) - 6, v + randomInt(13) - 6, randomInt(256));
+        }
+        else if(kind == 1)
+        {
+            Pixel *c = &colorList->colors[randomInt(colorList->count)];
+            pixelSet(pixel, c->r + randomInt(17) - 8, c->g + randomInt(17) - 8, c->b + randomInt(17) - 8, randomInt(256));
+        }
+        else
+        {
+            pixelSet(pixel, randomInt(256), randomInt(256), randomInt(256), randomInt(256));
+        }
+    }
+    return zbmp;
+}
+
+typedef struct CheckPredicate
+{
+    const char *name;
+    zFindBoxPixelMatchFunc func;
+    void *userdata;
+} CheckPredicate;
+
+typedef struct CheckFrames
+{
+    zBitmap *frames[MAX_EXPECTED + 16];
+    const char *names[MAX_EXPECTED + 16];
+    int count;
+    int bestLevel;
+    CheckPredicate predicates[4];
+    int predicateCount;
+} CheckFrames;
+
+// The row kernels (through zBitmapFindBoxes, which hands back its histograms) against the
+// predicates themselves, pixel by pixel
+static int checkRowKernels(CheckFrames *check)
+{
+    int failures = 0;
+    int searches = 0;
+    int f, p, t, level;
+
+    for(f = 0; f < check->count; ++f)
+    {
+        zBitmap *zbmp = check->frames[f];
+        int *colCounts = (int *)malloc(sizeof(int) * zbmp->w);
+        int *rowCounts = (int *)malloc(sizeof(int) * zbmp->h);
+        int *refCols = (int *)malloc(sizeof(int) * zbmp->w);
+        int *refRows = (int *)malloc(sizeof(int) * zbmp->h);
+        for(t = 0; t < 8; ++t)
+        {
+            RECT sub;
+            if(t == 0)
+            {
+                sub.left = 0;
+                sub.top = 0;
+                sub.right = zbmp->w;
+                sub.bottom = zbmp->h;
+            }
+            else
+            {
+                randomSubRect(zbmp, &sub);
+            }
+            for(p = 0; p < check->predicateCount; ++p)
+            {
+                CheckPredicate *predicate = &check->predicates[p];
+                int i, j;
+                memset(refCols, 0, sizeof(int) * zbmp->w);
+                memset(refRows, 0, sizeof(int) * zbmp->h);
+                for(j = sub.top; j < sub.bottom; ++j)
+                {
+                    for(i = sub.left; i < sub.right; ++i)
+                    {
+                        if(predicate->func(&zbmp->pixels[i + (j * zbmp->w)], predicate->userdata))
+                        {
+                            ++refCols[i];
+                            ++refRows[j];
+                        }
+                    }
+                }
+                for(level = check->bestLevel; level >= Z_KERNEL_SCALAR; --level)
+                {
+                    zFindBoxQuery query;
+                    memset(&query, 0, sizeof(query));
+                    query.subRect = &sub;
+                    query.func = predicate->func;
+                    query.userdata = predicate->userdata;
+                    query.lineToleranceX = 0.5f;
+                    query.lineToleranceY = 0.5f;
+                    query.colCounts = colCounts;
+                    query.rowCounts = rowCounts;
+                    zSetKernelLevel(level);
+                    zBitmapFindBoxes(zbmp, &query, 1);
+                    ++searches;
+                    if(memcmp(colCounts, refCols, sizeof(int) * zbmp->w) || memcmp(rowCounts, refRows, sizeof(int) * zbmp->h))
+                    {
+                        printf("FAIL kernels: %s on %s at %s, sub [%d, %d, %d, %d]\n", predicate->name,
+                            check->names[f], sLevelNames[level], sub.left, sub.top, sub.right, sub.bottom);
+                        ++failures;
+                    }
+                }
+            }
+        }
+        free(colCounts);
+        free(rowCounts);
+        free(refCols);
+        free(refRows);
+    }
+    zSetKernelLevel(check->bestLevel);
+    if(!failures)
+    {
+        printf("ok   kernels: %d searches match their predicates\n", searches);
+    }
+    return failures;
+}
+
+// zFrameDiffUpdate's SIMD tile hashes against the scalar one
+static int checkTileHashes(CheckFrames *check)
+{
+    int failures = 0;
+    int f, level;
+
+    for(f = 0; f < check->count; ++f)
+    {
+        zBitmap *zbmp = check->frames[f];
+        unsigned int *reference = NULL;
+        int tiles = 0;
+        for(level = Z_KERNEL_SCALAR; level <= check->bestLevel; ++level)
+        {
+            zFrameDiff *diff = zFrameDiffCreate();
+            zSetKernelLevel(level);
+            zFrameDiffUpdate(diff, zbmp);
+            if(!reference)
+            {
+                tiles = diff->tilesX * diff->tilesY;
+                reference = (unsigned int *)malloc(sizeof(unsigned int) * tiles);
+                memcpy(reference, diff->hashes, sizeof(unsigned int) * tiles);
+            }
+            else if(memcmp(reference, diff->hashes, sizeof(unsigned int) * tiles))
+            {
+                printf("FAIL tile hash: %s at %s differs from scalar\n", check->names[f], sLevelNames[level]);
+                ++failures;
+            }
+            zFrameDiffDestroy(diff);
+        }
+        free(reference);
+    }
+    zSetKernelLevel(check->bestLevel);
+    if(!failures)
+    {
+        printf("ok   tile hash: %d frames hash the same at every level\n", check->count);
+    }
+    return failures;
+}
+
+// zMatchTable's counts and box searches against counting the pixels and zBitmapFindBox
+static int checkMatchTables(CheckFrames *check)
+{
+    int failures = 0;
+    int queries = 0;
+    int f, p, t;
+
+    for(f = 0; f < check->count; ++f)
+    {
+        zBitmap *zbmp = check->frames[f];
+        for(p = 0; p < check->predicateCount; ++p)
+        {
+            CheckPredicate *predicate = &check->predicates[p];
+            zMatchTable *table = zMatchTableCreate(zbmp, predicate->func, predicate->userdata);
+            for(t = 0; t < 8; ++t)
+            {
+                RECT sub, expectedBox, box;
+                int expected = 0;
+                int i, j;
+                randomSubRect(zbmp, &sub);
+                for(j = sub.top; j < sub.bottom; ++j)
+                {
+                    for(i = sub.left; i < sub.right; ++i)
+                    {
+                        expected += predicate->func(&zbmp->pixels[i + (j * zbmp->w)], predicate->userdata) ? 1 : 0;
+                    }
+                }
+                zBitmapFindBox(zbmp, &sub, predicate->func, predicate->userdata, 0.5f, 0.9f, &expectedBox, 0);
+                zMatchTableFindBox(table, &sub, 0.5f, 0.9f, &box);
+                ++queries;
+                if((zMatchTableCount(table, &sub) != expected) || memcmp(&box, &expectedBox, sizeof(RECT)))
+                {
+                    printf("FAIL match table: %s on %s, sub [%d, %d, %d, %d]\n", predicate->name, check->names[f],
+                        sub.left, sub.top, sub.right, sub.bottom);
+                    ++failures;
+                }
+            }
+            zMatchTableDestroy(table);
+        }
+    }
+    if(!failures)
+    {
+        printf("ok   match table: %d counts and boxes match direct searches\n", queries);
+    }
+    return failures;
+}
+
+// zBitmapFindBoxParallel against zBitmapFindBox, on pools that split the rows unevenly
+static int checkParallelFindBox(CheckFrames *check)
+{
+    static const int threadCounts[] = { 2, 3, 8 };
+    int failures = 0;
+    int searches = 0;
+    int n, f, p, t;
+
+    for(n = 0; n < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); ++n)
+    {
+        zWorkerPool *pool = zWorkerPoolCreate(threadCounts[n]);
+        for(f = 0; f < check->count; ++f)
+        {
+            zBitmap *zbmp = check->frames[f];
+            for(t = 0; t < 4; ++t)
+            {
+                RECT sub;
+                RECT *subRect = NULL;
+                if(t > 0)
+                {
+                    randomSubRect(zbmp, &sub);
+                    subRect = &sub;
+                }
+                for(p = 0; p < check->predicateCount; ++p)
+                {
+                    CheckPredicate *predicate = &check->predicates[p];
+                    RECT expectedBox, box;
+                    zBitmapFindBox(zbmp, subRect, predicate->func, predicate->userdata, 0.5f, 0.9f, &expectedBox, 0);
+                    zBitmapFindBoxParallel(pool, zbmp, subRect, predicate->func, predicate->userdata, 0.5f, 0.9f, &box);
+                    ++searches;
+                    if(memcmp(&box, &expectedBox, sizeof(RECT)))
+                    {
+                        printf("FAIL parallel FindBox: %s on %s with %d threads\n", predicate->name, check->names[f], pool->threadCount);
+                        ++failures;
+                    }
+                }
+            }
+        }
+        zWorkerPoolDestroy(pool);
+    }
+    if(!failures)
+    {
+        printf("ok   parallel FindBox: %d searches match the serial scan\n", searches);
+    }
+    return failures;
+}
+
+// zBitmapFindBoxes against one zBitmapFindBox per query: every predicate at once, each over its
+// own (overlapping) sub-rect
+static int checkFusedFindBoxes(CheckFrames *check)
+{
+    int failures = 0;
+    int searches = 0;
+    int f, q, t;
+
+    for(f = 0; f < check->count; ++f)
+    {
+        zBitmap *zbmp = check->frames[f];
+        for(t = 0; t < 4; ++t)
+        {
+            zFindBoxQuery queries[4];
+            RECT subs[4];
+            memset(queries, 0, sizeof(queries));
+            for(q = 0; q < check->predicateCount; ++q)
+            {
+                randomSubRect(zbmp, &subs[q]);
+                queries[q].subRect = (t > 0) ? &subs[q] : NULL;
+                queries[q].func = check->predicates[q].func;
+                queries[q].userdata = check->predicates[q].userdata;
+                queries[q].lineToleranceX = 0.5f;
+                queries[q].lineToleranceY = 0.9f;
+            }
+            zBitmapFindBoxes(zbmp, queries, check->predicateCount);
+            for(q = 0; q < check->predicateCount; ++q)
+            {
+                RECT expectedBox;
+                zBitmapFindBox(zbmp, queries[q].subRect, queries[q].func, queries[q].userdata, 0.5f, 0.9f, &expectedBox, 0);
+                ++searches;
+                if(memcmp(&queries[q].outputRect, &expectedBox, sizeof(RECT)))
+                {
+                    printf("FAIL fused FindBoxes: %s on %s\n", check->predicates[q].name, check->names[f]);
+                    ++failures;
+                }
+            }
+        }
+    }
+    if(!failures)
+    {
+        printf("ok   fused FindBoxes: %d queries match separate searches\n", searches);
+    }
+    return failures;
+}
+
+// zStreamAnalyzer's per-row score counts and champion-gray mask against the predicates, at every
+// kernel level
+static int checkStreamRows(CheckFrames *check)
+{
+    int failures = 0;
+    int f, level;
+
+    for(f = 0; f < check->count; ++f)
+    {
+        zBitmap *zbmp = check->frames[f];
+        for(level = Z_KERNEL_SCALAR; level <= check->bestLevel; ++level)
+        {
+            zStreamAnalyzer *stream = zStreamAnalyzerCreate(zbmp->w, zbmp->h, 0);
+            int bad = 0;
+            int i, j;
+            zSetKernelLevel(level);
+            for(j = 0; j < zbmp->h; ++j)
+            {
+                zStreamAnalyzerPushRow(stream, &zbmp->pixels[j * zbmp->w]);
+            }
+            for(j = 0; (j < zbmp->h) && !bad; ++j)
+            {
+                int expected = 0;
+                for(i = 0; i < zbmp->w; ++i)
+                {
+                    Pixel *pixel = &zbmp->pixels[j * zbmp->w + i];
+                    int gray = (stream->grayMask[(size_t)j * stream->maskWords + (i >> 5)] >> (i & 31)) & 1;
+                    expected += check->predicates[0].func(pixel, check->predicates[0].userdata);
+                    if(gray != pixelIsAGray(pixel, &gChampBoxGray))
+                    {
+                        bad = 1;
+                    }
+                }
+                if(stream->rowCounts[j] != expected)
+                {
+                    bad = 1;
+                }
+            }
+            if(bad)
+            {
+                printf("FAIL stream rows: %s at %s, row %d\n", check->names[f], sLevelNames[level], j - 1);
+                ++failures;
+            }
+            zStreamAnalyzerDestroy(stream);
+        }
+    }
+    zSetKernelLevel(check->bestLevel);
+    if(!failures)
+    {
+        printf("ok   stream rows: %d frames match the predicates at every level\n", check->count);
+    }
+    return failures;
+}
+
+static int selfCheck(const char *dir)
+{
+    static const int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 31, 5 }, { 33, 9 }, { 65, 17 }, { 127, 33 }, { 257, 40 }, { 1023, 7 } };
+    Pixel scoreColors[4];
+    Pixel manyColors[40];
+    struct ColorList scoreList;
+    struct ColorList manyList;
+    zColorClass *champClass;
+    CheckFrames check;
+    int failures = 0;
+    int i;
+
+    // findScoreboard's scoreboard colors, plus a list too long for the SIMD color kernels
+    pixelSet(&scoreColors[0], 24, 63, 60, 4);
+    pixelSet(&scoreColors[1], 33, 69, 61, 4);
+    pixelSet(&scoreColors[2], 31, 63, 59, 7);
+    pixelSet(&scoreColors[3], 34, 74, 64, 3);
+    scoreList.colors = scoreColors;
+    scoreList.count = 4;
+    for(i = 0; i < 40; ++i)
+    {
+        pixelSet(&manyColors[i], 20 + randomInt(40), 50 + randomInt(40), 40 + randomInt(40), randomInt(6));
+    }
+    manyList.colors = manyColors;
+    manyList.count = 40;
+    champClass = zColorClassCreate();
+    zColorClassAddGrayRange(champClass, &gChampBoxGray);
+
+    memset(&check, 0, sizeof(check));
+    check.bestLevel = zSetKernelLevel(Z_KERNEL_AVX2);
+    check.predicates[0].name = "pixelMatchesColors";
+    check.predicates[0].func = pixelMatchesColors;
+    check.predicates[0].userdata = &scoreList;
+    check.predicates[1].name = "pixelMatchesColors (40 colors)";
+    check.predicates[1].func = pixelMatchesColors;
+    check.predicates[1].userdata = &manyList;
+    check.predicates[2].name = "pixelIsAGray";
+    check.predicates[2].func = pixelIsAGray;
+    check.predicates[2].userdata = &gChampBoxGray;
+    check.predicates[3].name = "pixelInColorClass";
+    check.predicates[3].func = pixelInColorClass;
+    check.predicates[3].userdata = champClass;
+    check.predicateCount = 4;
+
+    for(i = 0; i < sExpectedCount; ++i)
+    {
+        char path[512 + sizeof(sExpected[i].file)];
+        zBitmap *zbmp;
+        strcpy(path, dir);
+        strcat(path, sExpected[i].file);
+        zbmp = loadScoreboard(path);
+        if(!zbmp)
+        {
+            printf("FAIL %s: could not be loaded\n", sExpected[i].file);
+            ++failures;
+            continue;
+        }
+        check.frames[check.count] = zbmp;
+        check.names[check.count] = sExpected[i].file;
+        ++check.count;
+    }
+    for(i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); ++i)
+    {
+        check.frames[check.count] = randomBitmap(sizes[i][0], sizes[i][1], &scoreList);
+        check.names[check.count] = "random";
+        ++check.count;
+    }
+
+    printf("kernel levels up to %s\n", sLevelNames[check.bestLevel]);
+    failures += checkRowKernels(&check);
+    failures += checkTileHashes(&check);
+    failures += checkMatchTables(&check);
+    failures += checkParallelFindBox(&check);
+    failures += checkFusedFindBoxes(&check);
+    failures += checkStreamRows(&check);
+
+    for(i = 0; i < check.count; ++i)
+    {
+        zBitmapDestroy(check.frames[i]);
+    }
+    zColorClassDestroy(champClass);
+    printf("%d self-check failures\n", failures);
+    return failures;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: zregress [-e expected] [-b baseline] [-n runs] [-t threshold] [-m minms] [-s] [-r] [-g] [-k]\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *expectedFile = "images/expected.txt";
+    const char *baselineFile = NULL;
+    char dir[512];
+    char *slash;
+    int runs = 15;
+    double threshold = 0.25;
+    double minMs = 0.05;
+    int record = 0;
+    int regenerate = 0;
+    int streaming = 0;
+    int selfChecks = 0;
+    int failures = 0;
+    int haveBaseline = 0;
+    int i, k;
+
+    for(i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-e") && (i + 1 < argc))
+        {
+            expectedFile = argv[++i];
+        }
+        else if(!strcmp(argv[i], "-b") && (i + 1 < argc))
+        {
+            baselineFile = argv[++i];
+        }
+        else if(!strcmp(argv[i], "-n") && (i + 1 < argc))
+        {
+            runs = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-t") && (i + 1 < argc))
+        {
+            threshold = atof(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-m") && (i + 1 < argc))
+        {
+            minMs = atof(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-s"))
+        {
+            streaming = 1;
+        }
+        else if(!strcmp(argv[i], "-r"))
+        {
+            record = 1;
+        }
+        else if(!strcmp(argv[i], "-g"))
+        {
+            regenerate = 1;
+        }
+        else if(!strcmp(argv[i], "-k"))
+        {
+            selfChecks = 1;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(regenerate && streaming)
+    {
+        fprintf(stderr, "zregress: -g records findScoreboard's results and can't be combined with -s\n");
+        return 1;
+    }
+    if(runs < 1)
+    {
+        runs = 1;
+    }
+    if(!baselineFile)
+    {
+        baselineFile = streaming ? "build/baseline-stream.txt" : "build/baseline.txt";
+    }
+
+    // image names in the expected file are relative to its directory
+    strncpy(dir, expectedFile, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = 0;
+    slash = strrchr(dir, '/');
+    if(slash)
+    {
+        slash[1] = 0;
+    }
+    else
+    {
+        dir[0] = 0;
+    }
+
+    if(!readExpected(expectedFile))
+    {
+        return 1;
+    }
+    readBaseline(baselineFile);
+
+    zSetVerbose(0);
+    zScoreboardInit();
+    if(selfChecks)
+    {
+        failures = selfCheck(dir);
+        zPngShutdown();
+        return failures ? 1 : 0;
+    }
+
+    for(i = 0; i < sExpectedCount; ++i)
+    {
+        Expected *e = &sExpected[i];
+        zScoreboardInfo info;
+        double medianMs[Z_STAGE_COUNT];
+        char path[sizeof(dir) + sizeof(e->file)];
+        int passed = 1;
+
+        strcpy(path, dir);
+        strcat(path, e->file);
+        if(!analyze(path, runs, streaming, &info, medianMs))
+        {
+            printf("FAIL %s: could not be analyzed consistently\n", e->file);
+            ++failures;
+            continue;
+        }
+
+        // what's recorded is then checked like anything else, so it can't fail
+        if(regenerate)
+        {
+            memcpy(&e->info, &info, sizeof(zScoreboardInfo));
+        }
+        if(record)
+        {
+            memcpy(e->baselineMs, medianMs, sizeof(medianMs));
+        }
+
+        if(!sameInfo(&e->info, &info))
+        {
+            printf("FAIL %s: detection drifted\n", e->file);
+            printInfo("expected", &e->info);
+            printInfo("got     ", &info);
+            passed = 0;
+        }
+        printf("%s %s:", passed ? "ok  " : "    ", e->file);
+        for(k = 0; k < Z_STAGE_COUNT; ++k)
+        {
+            printf(" %s %.3f", zStageNames[k], medianMs[k]);
+            if(e->baselineMs[k] >= 0.0)
+            {
+                double limit = e->baselineMs[k] * (1.0 + threshold);
+                haveBaseline = 1;
+                printf(" (%+.0f%%)", (e->baselineMs[k] > 0.0) ? (100.0 * (medianMs[k] / e->baselineMs[k] - 1.0)) : 0.0);
+                if((medianMs[k] > limit) && (medianMs[k] - e->baselineMs[k] > minMs))
+                {
+                    printf(" SLOW");
+                    passed = 0;
+                }
+            }
+        }
+        printf("\n");
+        if(!passed)
+        {
+            ++failures;
+        }
+    }
+
+    if((regenerate && !writeExpected(expectedFile)) || (record && !writeBaseline(baselineFile)))
+    {
+        return 1;
+    }
+    if(!haveBaseline)
+    {
+        printf("no timing baseline in %s; run with -r to record one\n", baselineFile);
+    }
+    printf("%d of %d images failed (median of %d runs, threshold %.0f%%)\n", failures, sExpectedCount, runs, threshold * 100.0);
+    zPngShutdown();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+// zstripe: rewrites screenshots as striped PNGs and checks they decode in parallel.
+//
+//   zstripe [-r rows] [-z level] [-j threads] [-n runs] in.png out.png
+//
+// The output is an ordinary 8-bit RGB PNG (any viewer opens it) whose compressed data restarts
+// every rows rows (64 by default) and is indexed by a private stRP chunk; see zSaveStripedPng.
+// It's decoded again and compared pixel for pixel with the input, then timed against a serial
+// decode of the same file (median of runs), with -j threads (one per CPU by default).
+
+#include "zcore.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: zstripe [-r rows] [-z level] [-j threads] [-n runs] in.png out.png\n");
+}
+
+static long fileSize(const char *file_name)
+{
+    long size = -1;
+    FILE *fp = fopen(file_name, "rb");
+    if(fp)
+    {
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fclose(fp);
+    }
+    return size;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x < y) ? -1 : (x > y);
+}
+
+// Median decode time with the given strip thread count
+static double timeDecode(const char *file_name, int threads, int runs)
+{
+    double *times = (double *)malloc(runs * sizeof(double));
+    double median;
+    int i;
+    zSetPngStripThreads(threads);
+    for(i = 0; i < runs; ++i)
+    {
+        double start = zTimeNow();
+        zBitmap *zbmp = loadScoreboard(file_name);
+        times[i] = zTimeNow() - start;
+        zBitmapDestroy(zbmp);
+    }
+    qsort(times, runs, sizeof(double), compareDoubles);
+    median = times[runs / 2];
+    free(times);
+    return median;
+}
+
+int main(int argc, char **argv)
+{
+    const char *input = NULL;
+    const char *output = NULL;
+    zBitmap *original;
+    zBitmap *decoded;
+    int stripRows = 64;
+    int level = 6;
+    int threads = 0;
+    int runs = 9;
+    double serialMs, stripedMs;
+    int i;
+
+    for(i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-r") && (i + 1 < argc))
+        {
+            stripRows = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-z") && (i + 1 < argc))
+        {
+            level = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-j") && (i + 1 < argc))
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-n") && (i + 1 < argc))
+        {
+            runs = atoi(argv[++i]);
+        }
+        else if((argv[i][0] == '-') || (input && output))
+        {
+            usage();
+            return 1;
+        }
+        else if(!input)
+        {
+            input = argv[i];
+        }
+        else
+        {
+            output = argv[i];
+        }
+    }
+    if(!output || (stripRows <= 0) || (level < 0) || (level > 9) || (runs <= 0))
+    {
+        usage();
+        return 1;
+    }
+
+    zSetVerbose(0);
+    original = loadScoreboard(input);
+    if(!original)
+    {
+        fprintf(stderr, "couldn't load %s\n", input);
+        return 1;
+    }
+    if(!zSaveStripedPng(original, output, stripRows, level))
+    {
+        fprintf(stderr, "couldn't write %s\n", output);
+        zBitmapDestroy(original);
+        return 1;
+    }
+
+    zSetPngStripThreads((threads > 1) ? threads : 2);
+    decoded = loadScoreboard(output);
+    if(!decoded || (decoded->w != original->w) || (decoded->h != original->h)
+    || memcmp(decoded->pixels, original->pixels, sizeof(Pixel) * original->w * original->h))
+    {
+        fprintf(stderr, "%s doesn't decode back to %s\n", output, input);
+        zBitmapDestroy(original);
+        if(decoded)
+        {
+            zBitmapDestroy(decoded);
+        }
+        return 1;
+    }
+
+    serialMs = timeDecode(output, 1, runs);
+    stripedMs = timeDecode(output, threads, runs);
+    printf("%s: %dx%d, %ld -> %ld bytes, %d-row strips (%d), level %d\n", output, original->w, original->h,
+        fileSize(input), fileSize(output), stripRows, (original->h + stripRows - 1) / stripRows, level);
+    printf("decode: serial %.2f ms, striped %.2f ms on %d threads (%.2fx)\n", serialMs, stripedMs,
+        (threads > 0) ? threads : zCpuCount(), (stripedMs > 0.0) ? (serialMs / stripedMs) : 0.0);
+
+    zBitmapDestroy(original);
+    zBitmapDestroy(decoded);
+    zPngShutdown();
+    return 0;
+}